@@ -13,6 +13,10 @@ extern "C" {
 
 #define SH_EVENT_NAME_MAX   24
 
+#ifndef SH_EVENT_PARAM_BUF_SIZE
+#define SH_EVENT_PARAM_BUF_SIZE     8
+#endif
+
 enum sh_event_sub_mode {
     SH_EVENT_SUB_ASYNC = 0,
     SH_EVENT_SUB_SYNC,
@@ -28,21 +32,41 @@ typedef struct sh_event_map {
     uint8_t         cnt;
 } sh_event_map_t;
 
+/* a small parameter carried inline in the message, no extra allocation */
+typedef union sh_event_param {
+    uint32_t        u32;
+    int32_t         i32;
+    void           *ptr;
+    uint8_t         buf[SH_EVENT_PARAM_BUF_SIZE];
+} sh_event_param_t;
+
 typedef struct sh_event_msg {
     uint8_t         id;
     void           *data;
     size_t          size;
+    sh_event_param_t param;
 } sh_event_msg_t;
 
 typedef void(*event_cb)(const sh_event_msg_t *e);
+typedef int (*sh_event_msg_iter_fn)(const sh_event_msg_t *e, void *arg);
+
+struct sh_event_server;
+
+/* called around every async callback, is_post is false before it runs */
+typedef void (*sh_event_hook_fn)(struct sh_event_server *server, 
+                                 const sh_event_msg_t *e, 
+                                 bool is_post, void *arg);
 
 typedef struct sh_event_server {
     sh_event_obj_t  obj;
     sh_list_t       event_queue;
     bool            enable;
     event_cb       *cb;
+    event_cb       *cb_table;
     uint8_t        *sub_mode;
     sh_event_map_t *map;
+    sh_event_hook_fn hook;
+    void           *hook_arg;
 } sh_event_server_t;
 
 sh_event_map_t* sh_event_map_create(uint8_t *table, size_t size);
@@ -51,15 +75,22 @@ sh_event_server_t* sh_event_server_create(sh_event_map_t *map, const char *name)
 void sh_event_server_destroy(sh_event_server_t *server);
 int sh_event_server_start(sh_event_server_t *server);
 int sh_event_server_stop(sh_event_server_t *server);
+void sh_event_server_set_hook(sh_event_server_t *server, sh_event_hook_fn fn, void *arg);
+void sh_event_server_set_cb_table(sh_event_server_t *server, event_cb *table);
 int sh_event_subscribe_sync(sh_event_server_t *server, uint8_t event_id, event_cb cb);
 int sh_event_subscribe(sh_event_server_t *server, uint8_t event_id, event_cb cb);
 int sh_event_unsubscribe(sh_event_server_t *server, uint8_t event_id);
 int sh_event_unsubscribe_all(sh_event_server_t *server);
 int sh_event_publish(sh_event_map_t *map, uint8_t event_id);
+int sh_event_post(sh_event_server_t *server, uint8_t event_id, void *data, size_t size);
 int sh_event_publish_with_param(sh_event_map_t *map, uint8_t event_id, void *data, size_t size);
+int sh_event_publish_with_typed_param(sh_event_map_t *map, uint8_t event_id, const sh_event_param_t *param);
+int sh_event_post_with_typed_param(sh_event_server_t *server, uint8_t event_id, const sh_event_param_t *param);
+int sh_event_post_msg(sh_event_server_t *server, const sh_event_msg_t *msg);
 int sh_event_handler(sh_event_server_t *server);
 int sh_event_server_clear_msg(sh_event_server_t *server);
 int sh_event_server_get_msg_count(sh_event_server_t *server);
+int sh_event_server_for_each_msg(sh_event_server_t *server, sh_event_msg_iter_fn fn, void *arg);
 
 #ifdef __cplusplus
 }   /* extern "C" */ 
@@ -2,6 +2,7 @@
 #define __SH_FIFO_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,16 +16,24 @@ typedef struct sh_fifo {
     uint32_t esize;
     uint32_t size;
     void    *data;
+    bool     is_mirrored;
 } sh_fifo_t;
 
 int sh_fifo_init(sh_fifo_t *fifo, void *data, uint32_t size, uint32_t esize);
 sh_fifo_t* sh_fifo_create(uint32_t size, uint32_t esize);
 void sh_fifo_destroy(sh_fifo_t *fifo);
+#if defined(__linux__)
+sh_fifo_t* sh_fifo_create_mirrored(uint32_t size, uint32_t esize);
+#endif
 uint32_t sh_fifo_get_used_size(sh_fifo_t *fifo);
 uint32_t sh_fifo_get_unused_size(sh_fifo_t *fifo);
 uint32_t sh_fifo_in(sh_fifo_t *fifo, void *buf, uint32_t size);
 uint32_t sh_fifo_out_peek(sh_fifo_t *fifo, void *buf, uint32_t size);
 uint32_t sh_fifo_out(sh_fifo_t *fifo, void *buf, uint32_t size);
+int sh_fifo_in_prepare(sh_fifo_t *fifo, void **ptr, uint32_t *len);
+int sh_fifo_in_commit(sh_fifo_t *fifo, uint32_t len);
+int sh_fifo_out_peek_linear(sh_fifo_t *fifo, void **ptr, uint32_t *len);
+int sh_fifo_out_consume(sh_fifo_t *fifo, uint32_t len);
 
 #ifdef __cplusplus
 }   /* extern "C" */ 
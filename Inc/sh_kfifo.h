@@ -0,0 +1,38 @@
+#ifndef __SH_KFIFO_H__
+#define __SH_KFIFO_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sh_mem.h"
+
+/**
+ * a fifo of a power of two elements. in and out are free-running, they
+ * are masked on access and only their difference is the used size, so
+ * no slot is wasted and nothing is divided.
+ */
+typedef struct sh_kfifo {
+    uint32_t in;
+    uint32_t out;
+    uint32_t mask;
+    uint32_t esize;
+    void    *data;
+} sh_kfifo_t;
+
+int sh_kfifo_init(sh_kfifo_t *fifo, void *data, uint32_t size, uint32_t esize);
+sh_kfifo_t* sh_kfifo_create(uint32_t size, uint32_t esize);
+void sh_kfifo_destroy(sh_kfifo_t *fifo);
+uint32_t sh_kfifo_get_used_size(sh_kfifo_t *fifo);
+uint32_t sh_kfifo_get_unused_size(sh_kfifo_t *fifo);
+uint32_t sh_kfifo_in(sh_kfifo_t *fifo, const void *buf, uint32_t size);
+uint32_t sh_kfifo_out_peek(sh_kfifo_t *fifo, void *buf, uint32_t size);
+uint32_t sh_kfifo_out(sh_kfifo_t *fifo, void *buf, uint32_t size);
+
+#ifdef __cplusplus
+}   /* extern "C" */ 
+#endif
+
+#endif
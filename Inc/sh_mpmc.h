@@ -0,0 +1,36 @@
+#ifndef __SH_MPMC_H__
+#define __SH_MPMC_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sh_mem.h"
+
+#ifndef SH_MPMC_CACHE_LINE
+#define SH_MPMC_CACHE_LINE      64
+#endif
+
+/**
+ * a bounded lock-free queue for many producers and many consumers. every
+ * slot carries a sequence number, so producers and consumers only contend
+ * on their own index and never take the isr lock.
+ */
+typedef struct sh_mpmc sh_mpmc_t;
+
+sh_mpmc_t* sh_mpmc_create(uint32_t size, uint32_t esize);
+void sh_mpmc_destroy(sh_mpmc_t *mpmc);
+uint32_t sh_mpmc_get_size(sh_mpmc_t *mpmc);
+uint32_t sh_mpmc_get_used_size(sh_mpmc_t *mpmc);
+int sh_mpmc_enqueue(sh_mpmc_t *mpmc, const void *elem);
+int sh_mpmc_dequeue(sh_mpmc_t *mpmc, void *elem);
+uint32_t sh_mpmc_enqueue_batch(sh_mpmc_t *mpmc, const void *buf, uint32_t cnt);
+uint32_t sh_mpmc_dequeue_batch(sh_mpmc_t *mpmc, void *buf, uint32_t cnt);
+
+#ifdef __cplusplus
+}   /* extern "C" */ 
+#endif
+
+#endif
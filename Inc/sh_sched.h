@@ -0,0 +1,33 @@
+#ifndef __SH_SCHED_H__
+#define __SH_SCHED_H__
+
+#include <stdint.h>
+
+#include "sh_sm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__linux__)
+
+#ifndef SH_SCHED_WORKER_MAX
+#define SH_SCHED_WORKER_MAX     16
+#endif
+
+typedef struct sh_sched sh_sched_t;
+
+sh_sched_t* sh_sched_create(uint8_t worker_cnt, uint32_t tick_ns);
+void sh_sched_destroy(sh_sched_t *sched);
+int sh_sched_add(sh_sched_t *sched, sh_sm_t *sm);
+int sh_sched_remove(sh_sched_t *sched, sh_sm_t *sm);
+void sh_sched_wait_idle(sh_sched_t *sched);
+uint32_t sh_sched_get_run_count(sh_sched_t *sched);
+
+#endif
+
+#ifdef __cplusplus
+}   /* extern "C" */ 
+#endif
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "sh_event.h"
 #include "sh_timer.h"
+#include "sh_fifo.h"
 #include "sh_lib.h"
 
 #ifdef __cplusplus
@@ -11,34 +12,145 @@ extern "C" {
 
 #define SH_SM_NAME_MAX   16
 
+#ifndef SH_SM_DEPTH_MAX
+#define SH_SM_DEPTH_MAX         8
+#endif
+
+#define SH_SM_STATE_NONE        0xFF
+
+#ifndef USE_SH_SM_TRACE
+#define USE_SH_SM_TRACE         0
+#endif
+
+#define SH_SM_WAIT_FOREVER      SH_TICK_MAX
+
+#ifndef SH_SM_TIMER_POOL_SIZE
+#define SH_SM_TIMER_POOL_SIZE   8
+#endif
+
 enum sh_sm_timer_type {
     SH_SM_PRIVATE_TIMER = 0,
     SH_SM_GLOBAL_TIMER,
 };
 
+enum sh_sm_dispatch_mode {
+    SH_SM_DISPATCH_SERVER = 0,
+    SH_SM_DISPATCH_TABLE,
+};
+
 typedef struct sh_sm sh_sm_t;
 
-typedef uint32_t (*sh_get_tick_fn)(void);
+/**
+ * an event timer id, negative when the timer could not be started. the
+ * slot of the timer is in the low 16 bits and a generation above, so an
+ * id is no longer reused right after its timer expired or was removed.
+ * ids used to be small ints and sh_sm_remove_timer() took a uint8_t, an
+ * id kept in a uint8_t now hits the wrong timer or none, store it in a
+ * sh_sm_timer_id_t.
+ */
+typedef int32_t sh_sm_timer_id_t;
+
+typedef sh_timer_get_tick_fn sh_get_tick_fn;
+typedef void (*sh_sm_action_fn)(sh_sm_t *sm, uint8_t state_id);
+typedef void (*sh_sm_notify_fn)(sh_sm_t *sm, void *arg);
+typedef void (*sh_sm_wait_fn)(sh_sm_t *sm, sh_tick_t timeout, void *arg);
+
+typedef struct sh_sm_def sh_sm_def_t;
+
+/**
+ * a state machine instance of a shared, immutable sh_sm_def_t. it only
+ * holds the current state, the event queue and one state timer, so it is
+ * cheap enough to have one per connection or device.
+ */
+typedef struct sh_sm_inst {
+    const sh_sm_def_t *def;
+    sh_fifo_t queue;
+    sh_timer_t timer;
+    uint8_t state;
+    uint8_t timer_event_id;
+} sh_sm_inst_t;
+
+typedef void (*sh_sm_inst_cb)(sh_sm_inst_t *inst, const sh_event_msg_t *e);
+
+#if USE_SH_SM_TRACE
+#define SH_SM_TRACE_NO_EVENT    0xFF
+
+enum sh_sm_trace_type {
+    SH_SM_TRACE_TRANS = 0,
+    SH_SM_TRACE_EVENT,
+};
+
+/**
+ * a transition has no duration, its event is the one being handled when
+ * sh_sm_trans_to() was called. an event record covers one callback, to is
+ * the current state once it returned.
+ */
+typedef struct sh_sm_trace_rec {
+    sh_tick_t tick;
+    sh_tick_t dur;
+    uint8_t type;
+    uint8_t from;
+    uint8_t to;
+    uint8_t event;
+} sh_sm_trace_rec_t;
+#endif
 
 sh_sm_t* sh_sm_create(uint8_t *event_buf, size_t size, sh_get_tick_fn fn);
+sh_sm_t* sh_sm_create_with_timer_pool(uint8_t *event_buf, size_t size, sh_get_tick_fn fn, uint16_t timer_cnt);
 void sh_sm_destroy(sh_sm_t *sm);
+int sh_sm_set_dispatch_mode(sh_sm_t *sm, enum sh_sm_dispatch_mode mode);
+void sh_sm_set_notify(sh_sm_t *sm, sh_sm_notify_fn fn, void *arg);
+int sh_sm_next_deadline(sh_sm_t *sm, sh_tick_t *ticks_until);
+bool sh_sm_has_work(sh_sm_t *sm);
+int sh_sm_wait(sh_sm_t *sm, sh_sm_wait_fn fn, void *arg);
 int sh_sm_state_create(sh_sm_t *sm, uint8_t state_id);
 int sh_sm_state_destroy(sh_sm_t *sm, uint8_t state_id);
 int sh_sm_state_subscribe_event(sh_sm_t *sm, uint8_t state_id, uint8_t event_id, event_cb cb);
 int sh_sm_state_subscribe_events(sh_sm_t *sm, uint8_t state_id, uint8_t *event_buf, uint8_t event_cnt, event_cb cb);
 int sh_sm_state_unsubscribe_event(sh_sm_t *sm, uint8_t state_id, uint8_t event_id);
+int sh_sm_state_set_parent(sh_sm_t *sm, uint8_t state_id, uint8_t parent_id);
+int sh_sm_state_set_action(sh_sm_t *sm, uint8_t state_id, sh_sm_action_fn entry, sh_sm_action_fn exit);
 int sh_sm_trans_to(sh_sm_t *sm, uint8_t state_id);
 int sh_sm_handler(sh_sm_t *sm);
 int sh_sm_publish_event(sh_sm_t *sm, uint8_t event_id);
 int sh_sm_publish_event_with_param(sh_sm_t *sm, uint8_t event_id, unsigned int param);
-int sh_sm_start_global_timer(sh_sm_t *sm, uint32_t interval_tick, uint8_t event_id);
-int sh_sm_start_timer(sh_sm_t *sm, uint32_t interval_tick, uint8_t event_id);
-int sh_sm_start_timer_with_param(sh_sm_t *sm, uint32_t interval_tick, uint8_t event_id, unsigned int param);
-sh_timer_t* sh_sm_start_normal_timer(sh_sm_t *sm, uint32_t interval_tick, overtick_cb_fn cb);
-int sh_sm_remove_timer(sh_sm_t *sm, enum sh_sm_timer_type type, uint8_t timer_id);
+int sh_sm_publish_event_with_typed_param(sh_sm_t *sm, uint8_t event_id, const sh_event_param_t *param);
+sh_sm_timer_id_t sh_sm_start_global_timer(sh_sm_t *sm, sh_tick_t interval_tick, uint8_t event_id);
+sh_sm_timer_id_t sh_sm_start_timer(sh_sm_t *sm, sh_tick_t interval_tick, uint8_t event_id);
+sh_sm_timer_id_t sh_sm_start_timer_with_param(sh_sm_t *sm, sh_tick_t interval_tick, uint8_t event_id, unsigned int param);
+sh_sm_timer_id_t sh_sm_start_timer_with_typed_param(sh_sm_t *sm, sh_tick_t interval_tick, uint8_t event_id, const sh_event_param_t *param);
+sh_timer_t* sh_sm_start_normal_timer(sh_sm_t *sm, sh_tick_t interval_tick, overtick_cb_fn cb);
+int sh_sm_remove_timer(sh_sm_t *sm, enum sh_sm_timer_type type, sh_sm_timer_id_t timer_id);
 int sh_sm_remove_state_all_timer(sh_sm_t *sm, uint8_t state_id);
 void sh_sm_remove_all_global_timer(sh_sm_t *sm);
 unsigned int sh_sm_get_event_param(const sh_event_msg_t *msg);
+const sh_event_param_t* sh_sm_get_event_typed_param(const sh_event_msg_t *msg);
+int sh_sm_snapshot(sh_sm_t *sm, uint8_t *buf, size_t size);
+int sh_sm_restore(sh_sm_t *sm, const uint8_t *buf, size_t size);
+
+sh_sm_def_t* sh_sm_def_create(uint8_t state_cnt, uint8_t *event_buf, size_t size, sh_get_tick_fn fn);
+void sh_sm_def_destroy(sh_sm_def_t *def);
+int sh_sm_def_subscribe_event(sh_sm_def_t *def, uint8_t state_id, uint8_t event_id, sh_sm_inst_cb cb);
+int sh_sm_def_add_transition(sh_sm_def_t *def, uint8_t state_id, uint8_t event_id, uint8_t next_state_id);
+int sh_sm_inst_init(sh_sm_inst_t *inst, const sh_sm_def_t *def, sh_event_msg_t *queue_buf, uint32_t queue_size, uint8_t state_id);
+sh_sm_inst_t* sh_sm_inst_create(const sh_sm_def_t *def, uint32_t queue_size, uint8_t state_id);
+void sh_sm_inst_deinit(sh_sm_inst_t *inst);
+void sh_sm_inst_destroy(sh_sm_inst_t *inst);
+int sh_sm_inst_trans_to(sh_sm_inst_t *inst, uint8_t state_id);
+int sh_sm_inst_publish_event(sh_sm_inst_t *inst, uint8_t event_id, unsigned int param);
+int sh_sm_inst_start_timer(sh_sm_inst_t *inst, sh_list_t *head, sh_tick_t interval_tick, uint8_t event_id);
+void sh_sm_inst_stop_timer(sh_sm_inst_t *inst);
+int sh_sm_inst_handler(sh_sm_inst_t *inst);
+
+#if USE_SH_SM_TRACE
+int sh_sm_trace_enable(sh_sm_t *sm, uint16_t ring_size);
+void sh_sm_trace_disable(sh_sm_t *sm);
+uint16_t sh_sm_trace_get_count(sh_sm_t *sm);
+int sh_sm_trace_get(sh_sm_t *sm, uint16_t index, sh_sm_trace_rec_t *rec);
+sh_tick_t sh_sm_trace_get_residency(sh_sm_t *sm, uint8_t state_id);
+sh_tick_t sh_sm_trace_get_cb_tick(sh_sm_t *sm, uint8_t state_id, uint8_t event_id);
+int sh_sm_trace_export(sh_sm_t *sm, char *buf, size_t size, uint32_t tick_us);
+#endif
 
 #ifdef __cplusplus
 }   /* extern "C" */ 
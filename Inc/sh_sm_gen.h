@@ -0,0 +1,154 @@
+#ifndef __SH_SM_GEN_H__
+#define __SH_SM_GEN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sh_sm.h"
+#include "sh_isr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * a state machine generated at compile time from an X-macro table, one
+ * row per transition:
+ *
+ *   #define LED_TABLE(X)                                                  \
+ *       X(LED_OFF, EV_PRESS,   is_locked,        blink,    LED_BLINK)        \
+ *       X(LED_OFF, EV_PRESS,   SH_SM_GEN_ALWAYS, turn_on,  LED_ON)           \
+ *       X(LED_ON,  EV_PRESS,   SH_SM_GEN_ALWAYS, turn_off, LED_OFF)          \
+ *       X(LED_ON,  EV_TIMEOUT, SH_SM_GEN_ALWAYS, turn_off, LED_OFF)
+ *
+ *   SH_SM_GEN_DECLARE(led, 8)
+ *   ... guards and actions taking (led_t *sm, const sh_event_msg_t *e) ...
+ *   SH_SM_GEN_DEFINE(led, LED_TABLE)
+ *
+ * SH_SM_GEN_DECLARE() emits led_t with led_init(), led_publish() and the
+ * timer functions, so actions can use them, SH_SM_GEN_DEFINE() emits
+ * led_dispatch() and led_handler().
+ *
+ * the dispatcher compares (state << 8 | event) with the rows in table
+ * order, so the compiler can inline the guards and actions. rows may share
+ * a (state, event) pair, the first one whose guard holds runs its action,
+ * then moves to next unless next is SH_SM_STATE_NONE, and the rows after
+ * it are skipped. a last SH_SM_GEN_ALWAYS row of a pair is its else branch.
+ * like sh_sm_inst_t, leaving a state stops the state timer and events
+ * without a row are dropped. the queue and the timer are embedded, nothing is allocated.
+ *
+ * the timer needs sh_timer_sys_init().
+ */
+#define SH_SM_GEN_KEY(state, event)     ((uint16_t)(((uint16_t)(state) << 8) | (uint8_t)(event)))
+
+#define SH_SM_GEN_ALWAYS(sm, e)         true
+#define SH_SM_GEN_NO_ACTION(sm, e)      ((void)0)
+
+#define SH_SM_GEN_ROW(_state, _event, _guard, _action, _next)                   \
+    if (key == SH_SM_GEN_KEY(_state, _event)) {                                 \
+        if (_guard(sm, e)) {                                                    \
+            _action(sm, e);                                                     \
+            if ((_next) != SH_SM_STATE_NONE) {                                  \
+                sh_timer_stop(&sm->timer);                                      \
+                sm->state = (_next);                                            \
+            }                                                                   \
+            return 0;                                                           \
+        }                                                                       \
+        ret = 1;                                                                \
+    }
+
+#define SH_SM_GEN_DECLARE(name, queue_size)                                     \
+    typedef struct name {                                                       \
+        uint8_t state;                                                          \
+        uint8_t timer_event_id;                                                 \
+        sh_fifo_t queue;                                                        \
+        sh_timer_t timer;                                                       \
+        sh_event_msg_t queue_buf[queue_size];                                   \
+    } name##_t;                                                                 \
+                                                                                \
+    static inline int name##_publish(name##_t *sm, uint8_t event_id,            \
+                                     unsigned int param)                        \
+    {                                                                           \
+        sh_event_msg_t msg;                                                     \
+                                                                                \
+        memset(&msg, 0, sizeof(msg));                                           \
+        msg.id = event_id;                                                      \
+        msg.param.u32 = param;                                                  \
+                                                                                \
+        return (sh_fifo_in(&sm->queue, &msg, 1) == 1) ? 0 : -1;                 \
+    }                                                                           \
+                                                                                \
+    static inline void name##_timer_cb(void *param)                             \
+    {                                                                           \
+        name##_t *sm = (name##_t*)param;                                        \
+                                                                                \
+        name##_publish(sm, sm->timer_event_id, 0);                              \
+    }                                                                           \
+                                                                                \
+    static inline void name##_init(name##_t *sm, uint8_t state_id)              \
+    {                                                                           \
+        sm->state = state_id;                                                   \
+        sm->timer_event_id = 0;                                                 \
+                                                                                \
+        sh_fifo_init(&sm->queue, sm->queue_buf,                                 \
+                     sizeof(sm->queue_buf) / sizeof(sm->queue_buf[0]),          \
+                     sizeof(sh_event_msg_t));                                   \
+                                                                                \
+        sh_timer_init(&sm->timer, SH_TIMER_MODE_SINGLE, name##_timer_cb);       \
+        sh_timer_set_param(&sm->timer, sm);                                     \
+    }                                                                           \
+                                                                                \
+    static inline void name##_deinit(name##_t *sm)                              \
+    {                                                                           \
+        sh_timer_stop(&sm->timer);                                              \
+    }                                                                           \
+                                                                                \
+    static inline int name##_start_timer(name##_t *sm, sh_list_t *head,         \
+                                         sh_tick_t interval_tick,               \
+                                         uint8_t event_id)                      \
+    {                                                                           \
+        int level = sh_isr_disable();                                           \
+                                                                                \
+        sm->timer_event_id = event_id;                                          \
+        int ret = sh_timer_start(&sm->timer, head,                              \
+                                 sh_timer_get_current_tick(), interval_tick);   \
+                                                                                \
+        sh_isr_enable(level);                                                   \
+                                                                                \
+        return ret;                                                             \
+    }                                                                           \
+                                                                                \
+    static inline void name##_stop_timer(name##_t *sm)                          \
+    {                                                                           \
+        sh_timer_stop(&sm->timer);                                              \
+    }
+
+#define SH_SM_GEN_DEFINE(name, table)                                           \
+    /* return 0 if a row ran, 1 if all guards failed, -1 if there is no row */  \
+    static inline int name##_dispatch(name##_t *sm, const sh_event_msg_t *e)    \
+    {                                                                           \
+        uint16_t key = SH_SM_GEN_KEY(sm->state, e->id);                         \
+        int ret = -1;                                                           \
+                                                                                \
+        table(SH_SM_GEN_ROW)                                                    \
+                                                                                \
+        return ret;                                                             \
+    }                                                                           \
+                                                                                \
+    static inline int name##_handler(name##_t *sm)                              \
+    {                                                                           \
+        sh_event_msg_t msg;                                                     \
+                                                                                \
+        while (sh_fifo_out(&sm->queue, &msg, 1)) {                              \
+            name##_dispatch(sm, &msg);                                          \
+        }                                                                       \
+                                                                                \
+        return 0;                                                               \
+    }
+
+#ifdef __cplusplus
+}   /* extern "C" */ 
+#endif
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __SH_SPSC_FIFO_H__
+#define __SH_SPSC_FIFO_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sh_mem.h"
+
+#ifndef SH_SPSC_CACHE_LINE
+#define SH_SPSC_CACHE_LINE      64
+#endif
+
+/**
+ * a lock-free fifo for exactly one producer and one consumer, e.g. an
+ * isr and a thread. only the producer may call sh_spsc_fifo_in(), only
+ * the consumer the out functions. size counts elements of esize bytes,
+ * it must be a power of two and all of it can be used.
+ *
+ * like sh_fifo_t the struct can live in static memory and be set up with
+ * sh_spsc_fifo_init() on a caller buffer, do not touch its fields. in and
+ * out are free-running, each side owns one index and keeps a cached copy
+ * of the other one, the padding keeps the two sides and the read-only
+ * part on different cache lines whatever the alignment of the block is.
+ */
+typedef struct sh_spsc_fifo {
+    /* producer */
+    uint32_t    in;
+    uint32_t    out_cache;
+    uint8_t     pad0[SH_SPSC_CACHE_LINE - 2 * sizeof(uint32_t)];
+
+    /* consumer */
+    uint32_t    out;
+    uint32_t    in_cache;
+    uint8_t     pad1[SH_SPSC_CACHE_LINE - 2 * sizeof(uint32_t)];
+
+    uint32_t    mask;
+    uint32_t    esize;
+    uint8_t    *data;
+} sh_spsc_fifo_t;
+
+int sh_spsc_fifo_init(sh_spsc_fifo_t *fifo, void *data, uint32_t size, uint32_t esize);
+sh_spsc_fifo_t* sh_spsc_fifo_create(uint32_t size, uint32_t esize);
+void sh_spsc_fifo_destroy(sh_spsc_fifo_t *fifo);
+uint32_t sh_spsc_fifo_get_used_size(sh_spsc_fifo_t *fifo);
+uint32_t sh_spsc_fifo_get_unused_size(sh_spsc_fifo_t *fifo);
+uint32_t sh_spsc_fifo_in(sh_spsc_fifo_t *fifo, const void *buf, uint32_t size);
+uint32_t sh_spsc_fifo_out_peek(sh_spsc_fifo_t *fifo, void *buf, uint32_t size);
+uint32_t sh_spsc_fifo_out(sh_spsc_fifo_t *fifo, void *buf, uint32_t size);
+
+#ifdef __cplusplus
+}   /* extern "C" */ 
+#endif
+
+#endif
@@ -11,36 +11,98 @@
 extern "C" {
 #endif
 
-typedef uint32_t (*sh_timer_get_tick_fn)(void);
+#ifndef USE_SH_TIMER_TICK64
+#define USE_SH_TIMER_TICK64     0
+#endif
+
+#ifndef USE_SH_TIMER_STATS
+#define USE_SH_TIMER_STATS      0
+#endif
+
+#if USE_SH_TIMER_TICK64
+typedef uint64_t sh_tick_t;
+typedef int64_t sh_stick_t;
+#define SH_TICK_MAX     UINT64_MAX
+#else
+typedef uint32_t sh_tick_t;
+typedef int32_t sh_stick_t;
+#define SH_TICK_MAX     UINT32_MAX
+#endif
+
+typedef sh_tick_t (*sh_timer_get_tick_fn)(void);
 typedef void (*overtick_cb_fn)(void*);
+typedef void (*sh_timer_notify_fn)(sh_list_t *head);
 
 enum sh_timer_mode {
     SH_TIMER_MODE_SINGLE = 1,
     SH_TIMER_MODE_LOOP,
+    SH_TIMER_MODE_PERIODIC,
+};
+
+/* how a periodic timer catches up after the handler ran late */
+enum sh_timer_catchup {
+    SH_TIMER_CATCHUP_ALL = 0,   /* fire once for every missed period */
+    SH_TIMER_CATCHUP_SKIP,      /* drop the missed periods */
+    SH_TIMER_CATCHUP_ONCE,      /* fire once for all missed periods */
 };
 
 typedef struct sh_timer {
     bool enable;
     sh_list_t list;
     enum sh_timer_mode mode;
+    enum sh_timer_catchup catchup;
     void *param;
-    uint32_t interval_tick;
-    uint32_t overtick;
+    sh_tick_t interval_tick;
+    sh_tick_t overtick;
+    sh_tick_t slack_tick;
     overtick_cb_fn cb;
     sh_list_t *head;
 } sh_timer_t;
 
+#if USE_SH_TIMER_STATS
+#define SH_TIMER_STATS_BUCKETS  (sizeof(sh_tick_t) * 8 + 1)
+
+/* log2 histograms, bucket 0 counts zero, bucket n counts [2^(n-1), 2^n) */
+typedef struct sh_timer_stats {
+    sh_list_t list;
+    sh_list_t *head;
+    uint32_t cnt;
+    sh_tick_t late_max;
+    uint64_t late_sum;
+    uint32_t late_hist[SH_TIMER_STATS_BUCKETS];
+    sh_tick_t cb_max;
+    uint64_t cb_sum;
+    uint32_t cb_hist[SH_TIMER_STATS_BUCKETS];
+} sh_timer_stats_t;
+#endif
+
 int sh_timer_sys_init(sh_timer_get_tick_fn fn);
+sh_tick_t sh_timer_get_current_tick(void);
+void sh_timer_set_notify(sh_timer_notify_fn fn);
 void sh_timer_init(sh_timer_t *timer, enum sh_timer_mode mode, overtick_cb_fn cb);
 void sh_timer_set_param(sh_timer_t *timer, void *param);
 void sh_timer_set_mode(sh_timer_t *timer, enum sh_timer_mode mode);
-int sh_timer_start(sh_timer_t *timer, sh_list_t *head, uint32_t now, uint32_t interval_tick);
-void sh_timer_restart(sh_timer_t *timer, sh_list_t *head, uint32_t now);
+void sh_timer_set_slack(sh_timer_t *timer, sh_tick_t slack_tick);
+void sh_timer_set_catchup(sh_timer_t *timer, enum sh_timer_catchup catchup);
+int sh_timer_start(sh_timer_t *timer, sh_list_t *head, sh_tick_t now, sh_tick_t interval_tick);
+void sh_timer_restart(sh_timer_t *timer, sh_list_t *head, sh_tick_t now);
 void sh_timer_stop(sh_timer_t *timer);
 void sh_timer_handler(sh_list_t *head);
-bool sh_timer_is_time_out(uint32_t now, uint32_t set_tick);
+int sh_timer_next_expiry(sh_list_t *head, sh_tick_t now, sh_tick_t *ticks_until);
+int sh_timer_handler_tickless(sh_list_t *head, sh_tick_t *ticks_until);
+bool sh_timer_is_time_out(sh_tick_t now, sh_tick_t set_tick);
 sh_timer_t* sh_timer_create(enum sh_timer_mode mode, overtick_cb_fn cb);
 void sh_timer_destroy(sh_timer_t *timer);
+uint32_t sh_timer_get_saved_wakeups(void);
+void sh_timer_clear_saved_wakeups(void);
+
+#if USE_SH_TIMER_STATS
+int sh_timer_stats_attach(sh_timer_stats_t *stats, sh_list_t *head);
+void sh_timer_stats_detach(sh_timer_stats_t *stats);
+void sh_timer_stats_reset(sh_timer_stats_t *stats);
+sh_tick_t sh_timer_stats_get_late_mean(sh_timer_stats_t *stats);
+sh_tick_t sh_timer_stats_get_cb_mean(sh_timer_stats_t *stats);
+#endif
 
 #ifdef __cplusplus
 }   /* extern "C" */ 
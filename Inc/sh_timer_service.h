@@ -0,0 +1,41 @@
+#ifndef __SH_TIMER_SERVICE_H__
+#define __SH_TIMER_SERVICE_H__
+
+#include <stdint.h>
+
+#include "sh_timer.h"
+#include "sh_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__linux__)
+
+#define SH_TIMER_SERVICE_HEAD_MAX   8
+
+typedef struct sh_timer_service sh_timer_service_t;
+
+/* param of sh_timer_service_post_cb(), the event is posted to server */
+typedef struct sh_timer_service_event {
+    sh_event_server_t  *server;
+    uint8_t             event_id;
+} sh_timer_service_event_t;
+
+sh_timer_service_t* sh_timer_service_create(uint32_t cmd_cnt, uint32_t tick_ns);
+void sh_timer_service_destroy(sh_timer_service_t *service);
+int sh_timer_service_start_timer(sh_timer_service_t *service, sh_timer_t *timer, 
+                                 sh_list_t *head, sh_tick_t interval_tick);
+int sh_timer_service_restart_timer(sh_timer_service_t *service, sh_timer_t *timer, 
+                                   sh_list_t *head);
+int sh_timer_service_stop_timer(sh_timer_service_t *service, sh_timer_t *timer);
+uint32_t sh_timer_service_get_error_count(sh_timer_service_t *service);
+void sh_timer_service_post_cb(void *param);
+
+#endif
+
+#ifdef __cplusplus
+}   /* extern "C" */ 
+#endif
+
+#endif
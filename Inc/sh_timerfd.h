@@ -0,0 +1,35 @@
+#ifndef __SH_TIMERFD_H__
+#define __SH_TIMERFD_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sh_timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__linux__)
+
+typedef struct sh_timerfd {
+    sh_list_t   list;
+    sh_list_t  *head;
+    int         fd;
+    uint32_t    tick_ns;
+    bool        is_dispatching;
+} sh_timerfd_t;
+
+int sh_timerfd_init(sh_timerfd_t *tfd, sh_list_t *head, uint32_t tick_ns);
+void sh_timerfd_deinit(sh_timerfd_t *tfd);
+int sh_timerfd_get_fd(sh_timerfd_t *tfd);
+int sh_timerfd_arm(sh_timerfd_t *tfd);
+int sh_timerfd_dispatch(sh_timerfd_t *tfd);
+
+#endif
+
+#ifdef __cplusplus
+}   /* extern "C" */ 
+#endif
+
+#endif
@@ -102,6 +102,9 @@ static int sh_event_server_init(sh_event_server_t *server,
 
     server->map = map;
     server->enable = false;
+    server->cb_table = NULL;
+    server->hook = NULL;
+    server->hook_arg = NULL;
 
     return sh_event_obj_init((sh_event_obj_t *)server, name);
 }
@@ -226,6 +229,45 @@ int sh_event_server_stop(sh_event_server_t *server)
     return 0;
 }
 
+/**
+ * fn is called before and after each async callback of the server, e.g.
+ * to trace or time the dispatch.
+ */
+void sh_event_server_set_hook(sh_event_server_t *server, sh_event_hook_fn fn, void *arg)
+{
+    SH_ASSERT(server);
+
+    int level = sh_isr_disable();
+
+    server->hook = fn;
+    server->hook_arg = arg;
+
+    sh_isr_enable(level);
+}
+
+/**
+ * table replaces the subscribed callbacks of the server, it is indexed
+ * like the event map and is not copied, so one table can be shared and
+ * switched with a single call. the subscriptions still decide which
+ * events reach the server and how. NULL goes back to the subscribed
+ * callbacks.
+ */
+void sh_event_server_set_cb_table(sh_event_server_t *server, event_cb *table)
+{
+    SH_ASSERT(server);
+
+    int level = sh_isr_disable();
+
+    server->cb_table = table;
+
+    sh_isr_enable(level);
+}
+
+static event_cb sh_event_server_get_cb(sh_event_server_t *server, uint8_t index)
+{
+    return server->cb_table ? server->cb_table[index] : server->cb[index];
+}
+
 static int _sh_event_subscribe(sh_event_server_t *server, 
                                uint8_t event_id, 
                                event_cb cb, 
@@ -350,8 +392,9 @@ static bool sh_event_execute_sync_cb(sh_event_server_t *server,
         if (!server->enable) {
             return true;
         }
-        if (server->cb[index] != NULL) {
-            server->cb[index](msg);
+        event_cb cb = sh_event_server_get_cb(server, index);
+        if (cb != NULL) {
+            cb(msg);
         }
         return true;
     }
@@ -393,7 +436,8 @@ static void sh_event_check_if_msg_needs_to_free(sh_event_msg_ctrl_t *msg_ctrl)
 
 static sh_event_msg_ctrl_t* sh_event_msg_create(uint8_t event_id, 
                                                 void *data, 
-                                                size_t size)
+                                                size_t size,
+                                                const sh_event_param_t *param)
 {
     uint8_t *_data = NULL;
 
@@ -417,13 +461,20 @@ static sh_event_msg_ctrl_t* sh_event_msg_create(uint8_t event_id,
     event_ctrl->msg.size        = size;
     event_ctrl->ref             = 0;
 
+    if (param) {
+        event_ctrl->msg.param = *param;
+    } else {
+        memset(&event_ctrl->msg.param, 0, sizeof(sh_event_param_t));
+    }
+
     return event_ctrl;
 }
 
-int sh_event_publish_with_param(sh_event_map_t *map,
-                                uint8_t event_id, 
-                                void *data, 
-                                size_t size)
+static int _sh_event_publish(sh_event_map_t *map,
+                             uint8_t event_id, 
+                             void *data, 
+                             size_t size,
+                             const sh_event_param_t *param)
 {
     SH_ASSERT(map);
 
@@ -438,7 +489,7 @@ int sh_event_publish_with_param(sh_event_map_t *map,
 
     int level = sh_isr_disable();
 
-    sh_event_msg_ctrl_t *msg_ctrl = sh_event_msg_create(event_id, data, size);
+    sh_event_msg_ctrl_t *msg_ctrl = sh_event_msg_create(event_id, data, size, param);
     if (msg_ctrl == NULL) {
         goto fail;
     }
@@ -477,6 +528,88 @@ fail:
     return -1;
 }
 
+int sh_event_publish_with_param(sh_event_map_t *map,
+                                uint8_t event_id, 
+                                void *data, 
+                                size_t size)
+{
+    return _sh_event_publish(map, event_id, data, size, NULL);
+}
+
+/**
+ * the param is copied into the message, unlike data it is not allocated.
+ */
+int sh_event_publish_with_typed_param(sh_event_map_t *map, 
+                                      uint8_t event_id, 
+                                      const sh_event_param_t *param)
+{
+    SH_ASSERT(param);
+
+    return _sh_event_publish(map, event_id, NULL, 0, param);
+}
+
+static int _sh_event_post(sh_event_server_t *server, uint8_t event_id, 
+                          void *data, size_t size, const sh_event_param_t *param)
+{
+    SH_ASSERT(server);
+
+    uint8_t index = 0;
+    if (sh_event_get_index_by_id(server->map, event_id, &index)) {
+        return -1;
+    }
+
+    int level = sh_isr_disable();
+
+    if (!server->enable) {
+        sh_isr_enable(level);
+        return 0;
+    }
+
+    sh_event_msg_ctrl_t *msg_ctrl = sh_event_msg_create(event_id, data, size, param);
+    if (msg_ctrl == NULL) {
+        sh_isr_enable(level);
+        return -1;
+    }
+
+    if (!sh_event_execute_sync_cb(server, index, &msg_ctrl->msg)) {
+        if (sh_event_server_save_msg(server, msg_ctrl)) {
+            sh_event_check_if_msg_needs_to_free(msg_ctrl);
+            sh_isr_enable(level);
+            return -1;
+        }
+    }
+
+    sh_event_check_if_msg_needs_to_free(msg_ctrl);
+
+    sh_isr_enable(level);
+    return 0;
+}
+
+/**
+ * deliver an event to one server only, whether or not it is subscribed
+ * through the map. messages of events without a callback are dropped.
+ */
+int sh_event_post(sh_event_server_t *server, uint8_t event_id, void *data, size_t size)
+{
+    return _sh_event_post(server, event_id, data, size, NULL);
+}
+
+int sh_event_post_with_typed_param(sh_event_server_t *server, uint8_t event_id, 
+                                   const sh_event_param_t *param)
+{
+    SH_ASSERT(param);
+
+    return _sh_event_post(server, event_id, NULL, 0, param);
+}
+
+/* post a copy of msg, data and param included */
+int sh_event_post_msg(sh_event_server_t *server, const sh_event_msg_t *msg)
+{
+    SH_ASSERT(msg);
+
+    return _sh_event_post(server, msg->id, msg->data, msg->size, &msg->param);
+}
+
 int sh_event_publish(sh_event_map_t *map, uint8_t event_id)
 {
     SH_ASSERT(map);
@@ -518,8 +651,17 @@ static int sh_event_execute_async_cb(sh_event_server_t   *server,
     }
 
     if (is_cb_called) {
-        if (server->cb[index] != NULL) {
-            server->cb[index](&msg_ctrl->msg);
+        event_cb cb = sh_event_server_get_cb(server, index);
+        if (cb != NULL) {
+            if (server->hook) {
+                server->hook(server, &msg_ctrl->msg, false, server->hook_arg);
+            }
+
+            cb(&msg_ctrl->msg);
+
+            if (server->hook) {
+                server->hook(server, &msg_ctrl->msg, true, server->hook_arg);
+            }
         }
     }
 
@@ -654,3 +796,33 @@ int sh_event_server_get_msg_count(sh_event_server_t *server)
     return cnt;
 }
 
+/**
+ * call fn for every queued message of the server, oldest first, with the
+ * isr lock held. the walk stops at the first non-zero return of fn and
+ * that value is returned.
+ */
+int sh_event_server_for_each_msg(sh_event_server_t *server, 
+                                 sh_event_msg_iter_fn fn, void *arg)
+{
+    SH_ASSERT(server);
+    SH_ASSERT(fn);
+
+    int ret = 0;
+
+    int level = sh_isr_disable();
+
+    sh_list_for_each(node, &server->event_queue) {
+        sh_event_list_node_t *event_node = 
+            sh_container_of(node, sh_event_list_node_t, list);
+        sh_event_msg_ctrl_t *msg_ctrl = (sh_event_msg_ctrl_t*)event_node->data;
+
+        ret = fn(&msg_ctrl->msg, arg);
+        if (ret) {
+            break;
+        }
+    }
+
+    sh_isr_enable(level);
+
+    return ret;
+}
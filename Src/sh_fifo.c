@@ -1,3 +1,12 @@
+#if defined(__linux__)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include <string.h>
 
 #include "sh_assert.h"
@@ -23,6 +32,7 @@ int sh_fifo_init(sh_fifo_t *fifo, void *data, uint32_t size, uint32_t esize)
     fifo->data  = data;
     fifo->size  = size;
     fifo->esize = esize;
+    fifo->is_mirrored = false;
 
     return 0;
 }
@@ -51,12 +61,102 @@ void sh_fifo_destroy(sh_fifo_t *fifo)
         return;
     }
 
+#if defined(__linux__)
+    if (fifo->is_mirrored) {
+        munmap(fifo->data, 2 * (size_t)fifo->size * fifo->esize);
+        SH_FREE(fifo);
+        return;
+    }
+#endif
+
     if (fifo->data) {
         SH_FREE(fifo->data);
     }
     SH_FREE(fifo);
 }
 
+#if defined(__linux__)
+static uint32_t sh_fifo_gcd(uint32_t a, uint32_t b)
+{
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/**
+ * the buffer is mapped twice back to back, so every access of up to the
+ * fifo size is contiguous in memory and in, out and the zero-copy calls
+ * never split at the wrap point. size is rounded up until the buffer is
+ * a whole number of pages.
+ */
+sh_fifo_t* sh_fifo_create_mirrored(uint32_t size, uint32_t esize)
+{
+    if ((size == 0) || (esize == 0)) {
+        return NULL;
+    }
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0) {
+        return NULL;
+    }
+
+    uint32_t step = (uint32_t)page_size / sh_fifo_gcd(esize, (uint32_t)page_size);
+    uint64_t _size = ((uint64_t)size + step - 1) / step * step;
+    if (_size > UINT32_MAX) {
+        return NULL;
+    }
+
+    size_t len = (size_t)_size * esize;
+
+    sh_fifo_t *fifo = SH_MALLOC(sizeof(sh_fifo_t));
+    if (fifo == NULL) {
+        return NULL;
+    }
+
+    int fd = memfd_create("sh_fifo", MFD_CLOEXEC);
+    if (fd < 0) {
+        goto free_fifo;
+    }
+
+    if (ftruncate(fd, len)) {
+        goto close_fd;
+    }
+
+    /* reserve both halves first, then map the pages over them */
+    uint8_t *data = mmap(NULL, 2 * len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        goto close_fd;
+    }
+
+    if ((mmap(data, len, PROT_READ | PROT_WRITE, 
+              MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+        (mmap(data + len, len, PROT_READ | PROT_WRITE, 
+              MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+        goto unmap_data;
+    }
+
+    close(fd);
+
+    sh_fifo_init(fifo, data, (uint32_t)_size, esize);
+    fifo->is_mirrored = true;
+
+    return fifo;
+
+unmap_data:
+    munmap(data, 2 * len);
+close_fd:
+    close(fd);
+free_fifo:
+    SH_FREE(fifo);
+
+    return NULL;
+}
+#endif
+
 uint32_t sh_fifo_get_used_size(sh_fifo_t *fifo)
 {
     SH_ASSERT(fifo);
@@ -85,11 +185,15 @@ uint32_t sh_fifo_in(sh_fifo_t *fifo, void *buf, uint32_t size)
         size = unused_size;
     }
 
-    uint32_t _len = fifo->size - (fifo->in % fifo->size);
-    _len = MIN(_len, size);
+    if (fifo->is_mirrored) {
+        memcpy((uint8_t *)fifo->data + fifo->in * esize, buf, size * esize);
+    } else {
+        uint32_t _len = fifo->size - (fifo->in % fifo->size);
+        _len = MIN(_len, size);
 
-    memcpy((uint8_t *)fifo->data + fifo->in * esize, buf, _len * esize);
-    memcpy(fifo->data, (uint8_t *)buf + _len * esize, (size - _len) * esize);
+        memcpy((uint8_t *)fifo->data + fifo->in * esize, buf, _len * esize);
+        memcpy(fifo->data, (uint8_t *)buf + _len * esize, (size - _len) * esize);
+    }
 
     fifo->in = (fifo->in + size) % fifo->size;
 
@@ -110,11 +214,15 @@ uint32_t sh_fifo_out_peek(sh_fifo_t *fifo, void *buf, uint32_t size)
         size = used_size;
     }
 
-    uint32_t _len = fifo->size - (fifo->out % fifo->size);
-    _len = MIN(_len, size);
+    if (fifo->is_mirrored) {
+        memcpy(buf, (uint8_t *)fifo->data + fifo->out * esize, size * esize);
+    } else {
+        uint32_t _len = fifo->size - (fifo->out % fifo->size);
+        _len = MIN(_len, size);
 
-    memcpy(buf, (uint8_t *)fifo->data + fifo->out * esize, _len * esize);
-    memcpy((uint8_t *)buf + _len * esize, fifo->data, (size - _len) * esize);
+        memcpy(buf, (uint8_t *)fifo->data + fifo->out * esize, _len * esize);
+        memcpy((uint8_t *)buf + _len * esize, fifo->data, (size - _len) * esize);
+    }
 
     return size;
 }
@@ -131,9 +239,77 @@ uint32_t sh_fifo_out(sh_fifo_t *fifo, void *buf, uint32_t size)
     return len;
 }
 
+/* contiguous free space at in, written in place and then committed */
+int sh_fifo_in_prepare(sh_fifo_t *fifo, void **ptr, uint32_t *len)
+{
+    SH_ASSERT(fifo);
+    SH_ASSERT(ptr);
+    SH_ASSERT(len);
+
+    int level = sh_isr_disable();
+
+    uint32_t unused_size = sh_fifo_get_unused_size(fifo);
+
+    *ptr = (uint8_t *)fifo->data + fifo->in * fifo->esize;
+    *len = fifo->is_mirrored ? unused_size : MIN(unused_size, fifo->size - fifo->in);
+
+    sh_isr_enable(level);
+
+    return 0;
+}
+
+int sh_fifo_in_commit(sh_fifo_t *fifo, uint32_t len)
+{
+    SH_ASSERT(fifo);
+
+    int level = sh_isr_disable();
 
+    if ((len > sh_fifo_get_unused_size(fifo)) || 
+        (!fifo->is_mirrored && (len > fifo->size - fifo->in))) {
+        sh_isr_enable(level);
+        return -1;
+    }
 
+    fifo->in = (fifo->in + len) % fifo->size;
 
+    sh_isr_enable(level);
 
+    return 0;
+}
 
+/* contiguous used space at out, read in place and then consumed */
+int sh_fifo_out_peek_linear(sh_fifo_t *fifo, void **ptr, uint32_t *len)
+{
+    SH_ASSERT(fifo);
+    SH_ASSERT(ptr);
+    SH_ASSERT(len);
 
+    int level = sh_isr_disable();
+
+    uint32_t used_size = sh_fifo_get_used_size(fifo);
+
+    *ptr = (uint8_t *)fifo->data + fifo->out * fifo->esize;
+    *len = fifo->is_mirrored ? used_size : MIN(used_size, fifo->size - fifo->out);
+
+    sh_isr_enable(level);
+
+    return 0;
+}
+
+int sh_fifo_out_consume(sh_fifo_t *fifo, uint32_t len)
+{
+    SH_ASSERT(fifo);
+
+    int level = sh_isr_disable();
+
+    if (len > sh_fifo_get_used_size(fifo)) {
+        sh_isr_enable(level);
+        return -1;
+    }
+
+    fifo->out = (fifo->out + len) % fifo->size;
+
+    sh_isr_enable(level);
+
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include "sh_assert.h"
+#include "sh_kfifo.h"
+#include "sh_lib.h"
+#include "sh_isr.h"
+
+#ifndef SH_MALLOC
+    #define SH_MALLOC   malloc
+#endif
+
+#ifndef SH_FREE
+    #define SH_FREE     free
+#endif
+
+static bool sh_kfifo_is_power_of_2(uint32_t n)
+{
+    return (n != 0) && ((n & (n - 1)) == 0);
+}
+
+/**
+ * size is the number of elements and must be a power of two, all of
+ * them can be used.
+ */
+int sh_kfifo_init(sh_kfifo_t *fifo, void *data, uint32_t size, uint32_t esize)
+{
+    SH_ASSERT(fifo);
+    SH_ASSERT(data);
+
+    if (!sh_kfifo_is_power_of_2(size) || (esize == 0)) {
+        return -1;
+    }
+
+    fifo->in    = 0;
+    fifo->out   = 0;
+    fifo->mask  = size - 1;
+    fifo->esize = esize;
+    fifo->data  = data;
+
+    return 0;
+}
+
+sh_kfifo_t* sh_kfifo_create(uint32_t size, uint32_t esize)
+{
+    if (!sh_kfifo_is_power_of_2(size) || (esize == 0)) {
+        return NULL;
+    }
+
+    sh_kfifo_t *fifo = SH_MALLOC(sizeof(sh_kfifo_t));
+    if (fifo == NULL) {
+        return NULL;
+    }
+
+    void *data = SH_MALLOC(size * esize);
+    if (data == NULL) {
+        SH_FREE(fifo);
+        return NULL;
+    }
+
+    sh_kfifo_init(fifo, data, size, esize);
+
+    return fifo;
+}
+
+void sh_kfifo_destroy(sh_kfifo_t *fifo)
+{
+    if (fifo == NULL) {
+        return;
+    }
+
+    if (fifo->data) {
+        SH_FREE(fifo->data);
+    }
+    SH_FREE(fifo);
+}
+
+uint32_t sh_kfifo_get_used_size(sh_kfifo_t *fifo)
+{
+    SH_ASSERT(fifo);
+
+    return fifo->in - fifo->out;
+}
+
+uint32_t sh_kfifo_get_unused_size(sh_kfifo_t *fifo)
+{
+    SH_ASSERT(fifo);
+
+    return (fifo->mask + 1) - (fifo->in - fifo->out);
+}
+
+uint32_t sh_kfifo_in(sh_kfifo_t *fifo, const void *buf, uint32_t size)
+{
+    SH_ASSERT(fifo);
+    SH_ASSERT(buf);
+
+    int level = sh_isr_disable();
+
+    uint32_t esize = fifo->esize;
+
+    uint32_t unused_size = sh_kfifo_get_unused_size(fifo);
+    if (size > unused_size) {
+        size = unused_size;
+    }
+
+    uint32_t off = fifo->in & fifo->mask;
+    uint32_t _len = MIN(fifo->mask + 1 - off, size);
+
+    memcpy((uint8_t *)fifo->data + off * esize, buf, _len * esize);
+    memcpy(fifo->data, (const uint8_t *)buf + _len * esize, (size - _len) * esize);
+
+    fifo->in += size;
+
+    sh_isr_enable(level);
+
+    return size;
+}
+
+uint32_t sh_kfifo_out_peek(sh_kfifo_t *fifo, void *buf, uint32_t size)
+{
+    SH_ASSERT(fifo);
+    SH_ASSERT(buf);
+
+    uint32_t esize = fifo->esize;
+
+    uint32_t used_size = sh_kfifo_get_used_size(fifo);
+    if (size > used_size) {
+        size = used_size;
+    }
+
+    uint32_t off = fifo->out & fifo->mask;
+    uint32_t _len = MIN(fifo->mask + 1 - off, size);
+
+    memcpy(buf, (uint8_t *)fifo->data + off * esize, _len * esize);
+    memcpy((uint8_t *)buf + _len * esize, fifo->data, (size - _len) * esize);
+
+    return size;
+}
+
+uint32_t sh_kfifo_out(sh_kfifo_t *fifo, void *buf, uint32_t size)
+{
+    int level = sh_isr_disable();
+
+    uint32_t len = sh_kfifo_out_peek(fifo, buf, size);
+    fifo->out += len;
+
+    sh_isr_enable(level);
+
+    return len;
+}
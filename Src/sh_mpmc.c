@@ -0,0 +1,209 @@
+#include <string.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "sh_assert.h"
+#include "sh_mpmc.h"
+#include "sh_lib.h"
+
+#ifndef SH_MALLOC
+    #define SH_MALLOC   malloc
+#endif
+
+#ifndef SH_FREE
+    #define SH_FREE     free
+#endif
+
+/**
+ * slot n is free for the producer of ticket pos when its seq is pos and
+ * full for the consumer of ticket pos when its seq is pos + 1, consuming
+ * hands it to ticket pos + size. a slot is the seq followed by the
+ * element, the slots are stride bytes apart.
+ */
+struct sh_mpmc {
+    atomic_size_t tail;
+    uint8_t       pad0[SH_MPMC_CACHE_LINE - sizeof(atomic_size_t)];
+
+    atomic_size_t head;
+    uint8_t       pad1[SH_MPMC_CACHE_LINE - sizeof(atomic_size_t)];
+
+    size_t        mask;
+    uint32_t      esize;
+    uint32_t      stride;
+    uint8_t      *slot;
+};
+
+#define SH_MPMC_SEQ(mpmc, pos) \
+            ((atomic_size_t *)((mpmc)->slot + ((pos) & (mpmc)->mask) * (mpmc)->stride))
+#define SH_MPMC_ELEM(mpmc, pos) \
+            ((uint8_t *)SH_MPMC_SEQ(mpmc, pos) + sizeof(atomic_size_t))
+
+/**
+ * size is rounded up to a power of two.
+ */
+sh_mpmc_t* sh_mpmc_create(uint32_t size, uint32_t esize)
+{
+    if ((size == 0) || (size > 0x80000000) || (esize == 0)) {
+        return NULL;
+    }
+
+    uint32_t _size = 1;
+    while (_size < size) {
+        _size <<= 1;
+    }
+
+    sh_mpmc_t *mpmc = SH_MALLOC(sizeof(sh_mpmc_t));
+    if (mpmc == NULL) {
+        return NULL;
+    }
+
+    uint32_t align = sizeof(atomic_size_t);
+    mpmc->stride = (sizeof(atomic_size_t) + esize + align - 1) & ~(align - 1);
+
+    mpmc->slot = SH_MALLOC((size_t)_size * mpmc->stride);
+    if (mpmc->slot == NULL) {
+        SH_FREE(mpmc);
+        return NULL;
+    }
+
+    mpmc->mask = _size - 1;
+    mpmc->esize = esize;
+
+    for (size_t i = 0; i < _size; i++) {
+        atomic_init(SH_MPMC_SEQ(mpmc, i), i);
+    }
+
+    atomic_init(&mpmc->tail, 0);
+    atomic_init(&mpmc->head, 0);
+
+    return mpmc;
+}
+
+void sh_mpmc_destroy(sh_mpmc_t *mpmc)
+{
+    if (mpmc == NULL) {
+        return;
+    }
+
+    SH_FREE(mpmc->slot);
+    SH_FREE(mpmc);
+}
+
+uint32_t sh_mpmc_get_size(sh_mpmc_t *mpmc)
+{
+    SH_ASSERT(mpmc);
+
+    return (uint32_t)(mpmc->mask + 1);
+}
+
+/**
+ * only a snapshot while other threads are running.
+ */
+uint32_t sh_mpmc_get_used_size(sh_mpmc_t *mpmc)
+{
+    SH_ASSERT(mpmc);
+
+    size_t head = atomic_load_explicit(&mpmc->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&mpmc->tail, memory_order_acquire);
+
+    return (tail > head) ? (uint32_t)(tail - head) : 0;
+}
+
+/**
+ * claim up to cnt consecutive tickets from index, a ticket is ready when
+ * its slot seq is ticket + offset. return the first ticket and how many
+ * were claimed, 0 if the first one is not ready.
+ */
+static uint32_t sh_mpmc_claim(sh_mpmc_t *mpmc, atomic_size_t *index, 
+                              size_t offset, uint32_t cnt, size_t *first)
+{
+    if (cnt == 0) {
+        return 0;
+    }
+
+    size_t pos = atomic_load_explicit(index, memory_order_relaxed);
+
+    while (1) {
+        uint32_t n = 0;
+        intptr_t diff = 0;
+
+        for (; n < cnt; n++) {
+            size_t seq = atomic_load_explicit(SH_MPMC_SEQ(mpmc, pos + n), 
+                                              memory_order_acquire);
+            diff = (intptr_t)seq - (intptr_t)(pos + n + offset);
+            if (diff != 0) {
+                break;
+            }
+        }
+
+        if (n == 0) {
+            if (diff < 0) {
+                return 0;
+            }
+
+            /* another thread took the ticket, catch up with the index */
+            pos = atomic_load_explicit(index, memory_order_relaxed);
+            continue;
+        }
+
+        if (atomic_compare_exchange_weak_explicit(index, &pos, pos + n,
+                memory_order_relaxed, memory_order_relaxed)) {
+            *first = pos;
+            return n;
+        }
+    }
+}
+
+uint32_t sh_mpmc_enqueue_batch(sh_mpmc_t *mpmc, const void *buf, uint32_t cnt)
+{
+    SH_ASSERT(mpmc);
+    SH_ASSERT(buf);
+
+    size_t pos = 0;
+
+    cnt = sh_mpmc_claim(mpmc, &mpmc->tail, 0, cnt, &pos);
+
+    for (uint32_t i = 0; i < cnt; i++) {
+        memcpy(SH_MPMC_ELEM(mpmc, pos + i), 
+               (const uint8_t *)buf + i * mpmc->esize, mpmc->esize);
+        atomic_store_explicit(SH_MPMC_SEQ(mpmc, pos + i), pos + i + 1, 
+                              memory_order_release);
+    }
+
+    return cnt;
+}
+
+uint32_t sh_mpmc_dequeue_batch(sh_mpmc_t *mpmc, void *buf, uint32_t cnt)
+{
+    SH_ASSERT(mpmc);
+    SH_ASSERT(buf);
+
+    size_t pos = 0;
+
+    cnt = sh_mpmc_claim(mpmc, &mpmc->head, 1, cnt, &pos);
+
+    for (uint32_t i = 0; i < cnt; i++) {
+        memcpy((uint8_t *)buf + i * mpmc->esize, 
+               SH_MPMC_ELEM(mpmc, pos + i), mpmc->esize);
+        atomic_store_explicit(SH_MPMC_SEQ(mpmc, pos + i), pos + i + mpmc->mask + 1, 
+                              memory_order_release);
+    }
+
+    return cnt;
+}
+
+/**
+ * return -1 if the queue is full.
+ */
+int sh_mpmc_enqueue(sh_mpmc_t *mpmc, const void *elem)
+{
+    return (sh_mpmc_enqueue_batch(mpmc, elem, 1) == 1) ? 0 : -1;
+}
+
+/**
+ * return -1 if the queue is empty.
+ */
+int sh_mpmc_dequeue(sh_mpmc_t *mpmc, void *elem)
+{
+    return (sh_mpmc_dequeue_batch(mpmc, elem, 1) == 1) ? 0 : -1;
+}
@@ -0,0 +1,576 @@
+#if defined(__linux__)
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "sh_sched.h"
+#include "sh_lib.h"
+#include "sh_list.h"
+#include "sh_isr.h"
+#include "sh_assert.h"
+
+#ifndef SH_MALLOC
+    #define SH_MALLOC   malloc
+#endif
+
+#ifndef SH_FREE
+    #define SH_FREE     free
+#endif
+
+enum sh_sched_run_state {
+    SH_SCHED_IDLE = 0,
+    SH_SCHED_QUEUED,
+    SH_SCHED_RUNNING,
+    SH_SCHED_RERUN,
+};
+
+typedef struct sh_sched_entry {
+    sh_list_t list;
+    sh_list_t ready;
+    sh_list_t timer;
+    sh_tick_t deadline;
+    bool has_deadline;
+    atomic_bool is_removed;
+    atomic_int state;
+    sh_sm_t *sm;
+    sh_sched_t *sched;
+} sh_sched_entry_t;
+
+typedef struct sh_sched_worker {
+    pthread_mutex_t lock;
+    sh_list_t ready;
+    pthread_t thread;
+    sh_sched_t *sched;
+    uint8_t index;
+} sh_sched_worker_t;
+
+/**
+ * every worker owns a deque of ready sms, it takes work from the front of
+ * its own deque and steals from the back of the others when it runs dry.
+ * sms with running timers sit in a deadline list, the first idle worker
+ * sleeps until the earliest deadline. idle sms are in no list at all.
+ */
+struct sh_sched {
+    sh_sched_worker_t worker[SH_SCHED_WORKER_MAX];
+    uint8_t worker_cnt;
+    atomic_uint next_worker;
+    atomic_int ready_cnt;
+    atomic_int busy_cnt;
+    atomic_uint run_cnt;
+    atomic_bool is_running;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    sh_list_t entry_head;
+    sh_list_t deadline_head;
+    uint32_t tick_ns;
+};
+
+static __thread sh_sched_worker_t *sh_sched_current_worker = NULL;
+
+/**
+ * is_locked is true when the caller holds sched->lock.
+ */
+static void sh_sched_push(sh_sched_t *sched, sh_sched_entry_t *entry, bool is_locked)
+{
+    sh_sched_worker_t *worker = sh_sched_current_worker;
+
+    if ((worker == NULL) || (worker->sched != sched)) {
+        uint32_t index = atomic_fetch_add(&sched->next_worker, 1) % sched->worker_cnt;
+        worker = &sched->worker[index];
+    }
+
+    pthread_mutex_lock(&worker->lock);
+    sh_list_insert_before(&entry->ready, &worker->ready);
+    pthread_mutex_unlock(&worker->lock);
+
+    atomic_fetch_add(&sched->ready_cnt, 1);
+
+    if (!is_locked) {
+        pthread_mutex_lock(&sched->lock);
+    }
+    pthread_cond_signal(&sched->cond);
+    if (!is_locked) {
+        pthread_mutex_unlock(&sched->lock);
+    }
+}
+
+static void sh_sched_wake(sh_sched_t *sched, sh_sched_entry_t *entry, bool is_locked)
+{
+    int state = atomic_load(&entry->state);
+
+    while (1) {
+        if (state == SH_SCHED_IDLE) {
+            if (atomic_compare_exchange_weak(&entry->state, &state, SH_SCHED_QUEUED)) {
+                atomic_fetch_add(&sched->busy_cnt, 1);
+                sh_sched_push(sched, entry, is_locked);
+                return;
+            }
+        } else if (state == SH_SCHED_RUNNING) {
+            /* the worker running the sm runs it once more */
+            if (atomic_compare_exchange_weak(&entry->state, &state, SH_SCHED_RERUN)) {
+                return;
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+static void sh_sched_notify(sh_sm_t *sm, void *arg)
+{
+    sh_sched_entry_t *entry = (sh_sched_entry_t*)arg;
+
+    (void)sm;
+
+    sh_sched_wake(entry->sched, entry, false);
+}
+
+/**
+ * called after the entry went back to idle, wakes sh_sched_wait_idle()
+ * when it was the last busy one and sh_sched_remove() when it is removed.
+ */
+static void sh_sched_idle_done(sh_sched_t *sched, sh_sched_entry_t *entry, bool is_locked)
+{
+    if ((atomic_fetch_sub(&sched->busy_cnt, 1) == 1) || atomic_load(&entry->is_removed)) {
+        if (!is_locked) {
+            pthread_mutex_lock(&sched->lock);
+        }
+        pthread_cond_broadcast(&sched->cond);
+        if (!is_locked) {
+            pthread_mutex_unlock(&sched->lock);
+        }
+    }
+}
+
+static sh_sched_entry_t* sh_sched_take(sh_sched_worker_t *worker, bool is_steal)
+{
+    sh_sched_entry_t *entry = NULL;
+
+    pthread_mutex_lock(&worker->lock);
+
+    if (!sh_list_isempty(&worker->ready)) {
+        sh_list_t *node = is_steal ? worker->ready.prev : worker->ready.next;
+        entry = sh_container_of(node, sh_sched_entry_t, ready);
+        sh_list_remove(node);
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    return entry;
+}
+
+static sh_sched_entry_t* sh_sched_pop(sh_sched_worker_t *worker)
+{
+    sh_sched_t *sched = worker->sched;
+
+    sh_sched_entry_t *entry = sh_sched_take(worker, false);
+
+    for (int i = 1; (entry == NULL) && (i < sched->worker_cnt); i++) {
+        entry = sh_sched_take(&sched->worker[(worker->index + i) % sched->worker_cnt], true);
+    }
+
+    if (entry) {
+        atomic_fetch_sub(&sched->ready_cnt, 1);
+    }
+
+    return entry;
+}
+
+static void sh_sched_deadline_insert(sh_sched_t *sched, sh_sched_entry_t *entry)
+{
+    sh_list_t *pos = &sched->deadline_head;
+
+    sh_list_for_each(node, &sched->deadline_head) {
+        sh_sched_entry_t *_entry = sh_container_of(node, sh_sched_entry_t, timer);
+        if ((sh_stick_t)(_entry->deadline - entry->deadline) > 0) {
+            pos = node;
+            break;
+        }
+    }
+
+    sh_list_insert_before(&entry->timer, pos);
+    entry->has_deadline = true;
+}
+
+static void sh_sched_update_deadline(sh_sched_t *sched, sh_sched_entry_t *entry)
+{
+    sh_tick_t ticks_until = 0;
+    int ret = sh_sm_next_deadline(entry->sm, &ticks_until);
+    sh_tick_t now = sh_timer_get_current_tick();
+
+    pthread_mutex_lock(&sched->lock);
+
+    if (entry->has_deadline) {
+        sh_list_remove(&entry->timer);
+        entry->has_deadline = false;
+    }
+
+    if ((ret == 0) && !atomic_load(&entry->is_removed)) {
+        entry->deadline = now + ticks_until;
+        sh_sched_deadline_insert(sched, entry);
+
+        /* a sleeping worker may need to wake up earlier */
+        if (sched->deadline_head.next == &entry->timer) {
+            pthread_cond_signal(&sched->cond);
+        }
+    }
+
+    pthread_mutex_unlock(&sched->lock);
+}
+
+/**
+ * the handler of an sm is never run by two workers at the same time,
+ * notifications that arrive while it runs make it run once more.
+ */
+static void sh_sched_run(sh_sched_t *sched, sh_sched_entry_t *entry)
+{
+    atomic_store(&entry->state, SH_SCHED_RUNNING);
+
+    if (!atomic_load(&entry->is_removed)) {
+        sh_sm_handler(entry->sm);
+        atomic_fetch_add(&sched->run_cnt, 1);
+        sh_sched_update_deadline(sched, entry);
+    }
+
+    int state = SH_SCHED_RUNNING;
+    if (!atomic_compare_exchange_strong(&entry->state, &state, SH_SCHED_IDLE)) {
+        if (!atomic_load(&entry->is_removed)) {
+            atomic_store(&entry->state, SH_SCHED_QUEUED);
+            sh_sched_push(sched, entry, false);
+            return;
+        }
+
+        /* a removed sm is not queued again, sh_sched_remove() waits for it */
+        atomic_store(&entry->state, SH_SCHED_IDLE);
+    }
+
+    sh_sched_idle_done(sched, entry, false);
+}
+
+/**
+ * take a queued entry back out of the worker deque it sits in, returns
+ * false when no deque holds it, a worker has taken it then. called with
+ * sched->lock held.
+ */
+static bool sh_sched_unqueue(sh_sched_t *sched, sh_sched_entry_t *entry)
+{
+    for (int i = 0; i < sched->worker_cnt; i++) {
+        sh_sched_worker_t *worker = &sched->worker[i];
+        bool is_found = false;
+
+        pthread_mutex_lock(&worker->lock);
+        sh_list_for_each(node, &worker->ready) {
+            if (node == &entry->ready) {
+                sh_list_remove(node);
+                is_found = true;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&worker->lock);
+
+        if (is_found) {
+            atomic_fetch_sub(&sched->ready_cnt, 1);
+            atomic_store(&entry->state, SH_SCHED_IDLE);
+            sh_sched_idle_done(sched, entry, true);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * called with sched->lock held.
+ */
+static void sh_sched_wake_due(sh_sched_t *sched, sh_tick_t now)
+{
+    sh_list_for_each_safe(node, &sched->deadline_head) {
+        sh_sched_entry_t *entry = sh_container_of(node, sh_sched_entry_t, timer);
+        if ((sh_stick_t)(entry->deadline - now) > 0) {
+            break;
+        }
+
+        sh_list_remove(&entry->timer);
+        entry->has_deadline = false;
+
+        sh_sched_wake(sched, entry, true);
+    }
+}
+
+static void sh_sched_wait(sh_sched_t *sched, sh_tick_t now)
+{
+    if (sh_list_isempty(&sched->deadline_head)) {
+        pthread_cond_wait(&sched->cond, &sched->lock);
+        return;
+    }
+
+    sh_sched_entry_t *entry =
+        sh_container_of(sched->deadline_head.next, sh_sched_entry_t, timer);
+
+    struct timespec ts;
+    uint64_t ns = (uint64_t)(entry->deadline - now) * sched->tick_ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ns += ts.tv_nsec;
+    ts.tv_sec += ns / 1000000000ull;
+    ts.tv_nsec = ns % 1000000000ull;
+
+    pthread_cond_timedwait(&sched->cond, &sched->lock, &ts);
+}
+
+static void* sh_sched_thread(void *arg)
+{
+    sh_sched_worker_t *worker = (sh_sched_worker_t*)arg;
+    sh_sched_t *sched = worker->sched;
+
+    sh_sched_current_worker = worker;
+
+    while (atomic_load(&sched->is_running)) {
+        sh_sched_entry_t *entry = sh_sched_pop(worker);
+        if (entry) {
+            sh_sched_run(sched, entry);
+            continue;
+        }
+
+        pthread_mutex_lock(&sched->lock);
+
+        sh_tick_t now = sh_timer_get_current_tick();
+        sh_sched_wake_due(sched, now);
+
+        if ((atomic_load(&sched->ready_cnt) == 0) && atomic_load(&sched->is_running)) {
+            sh_sched_wait(sched, now);
+        }
+
+        pthread_mutex_unlock(&sched->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * run the added sms on worker_cnt threads, tick_ns is the length of one
+ * sh_timer tick. register a sh_isr backed by a recursive mutex first, the
+ * sms are handled on several threads at once.
+ */
+sh_sched_t* sh_sched_create(uint8_t worker_cnt, uint32_t tick_ns)
+{
+    SH_ASSERT(tick_ns);
+
+    if ((worker_cnt == 0) || (worker_cnt > SH_SCHED_WORKER_MAX)) {
+        return NULL;
+    }
+
+    int level = sh_isr_disable();
+    sh_sched_t *sched = SH_MALLOC(sizeof(sh_sched_t));
+    sh_isr_enable(level);
+    if (sched == NULL) {
+        return NULL;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sched->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&sched->lock, NULL);
+
+    sh_list_init(&sched->entry_head);
+    sh_list_init(&sched->deadline_head);
+    sched->tick_ns = tick_ns;
+    sched->worker_cnt = 0;
+    atomic_init(&sched->next_worker, 0);
+    atomic_init(&sched->ready_cnt, 0);
+    atomic_init(&sched->busy_cnt, 0);
+    atomic_init(&sched->run_cnt, 0);
+    atomic_init(&sched->is_running, true);
+
+    for (int i = 0; i < worker_cnt; i++) {
+        sh_sched_worker_t *worker = &sched->worker[i];
+
+        pthread_mutex_init(&worker->lock, NULL);
+        sh_list_init(&worker->ready);
+        worker->sched = sched;
+        worker->index = i;
+    }
+
+    for (int i = 0; i < worker_cnt; i++) {
+        sched->worker_cnt = i;
+        if (pthread_create(&sched->worker[i].thread, NULL,
+                           sh_sched_thread, &sched->worker[i])) {
+            goto stop_worker;
+        }
+    }
+    sched->worker_cnt = worker_cnt;
+
+    return sched;
+
+stop_worker:
+    atomic_store(&sched->is_running, false);
+    pthread_mutex_lock(&sched->lock);
+    pthread_cond_broadcast(&sched->cond);
+    pthread_mutex_unlock(&sched->lock);
+
+    for (int i = 0; i < sched->worker_cnt; i++) {
+        pthread_join(sched->worker[i].thread, NULL);
+    }
+
+    level = sh_isr_disable();
+    SH_FREE(sched);
+    sh_isr_enable(level);
+
+    return NULL;
+}
+
+/**
+ * the sms that are still added are released from the scheduler, not
+ * destroyed.
+ */
+void sh_sched_destroy(sh_sched_t *sched)
+{
+    if (sched == NULL) {
+        return;
+    }
+
+    atomic_store(&sched->is_running, false);
+    pthread_mutex_lock(&sched->lock);
+    pthread_cond_broadcast(&sched->cond);
+    pthread_mutex_unlock(&sched->lock);
+
+    for (int i = 0; i < sched->worker_cnt; i++) {
+        pthread_join(sched->worker[i].thread, NULL);
+    }
+
+    int level = sh_isr_disable();
+
+    sh_list_for_each_safe(node, &sched->entry_head) {
+        sh_sched_entry_t *entry = sh_container_of(node, sh_sched_entry_t, list);
+        sh_sm_set_notify(entry->sm, NULL, NULL);
+        sh_list_remove(&entry->list);
+        SH_FREE(entry);
+    }
+
+    SH_FREE(sched);
+
+    sh_isr_enable(level);
+}
+
+/**
+ * the sm is run whenever an event is published to it or one of its timers
+ * is due, do not call sh_sm_handler() on it while it is added.
+ */
+int sh_sched_add(sh_sched_t *sched, sh_sm_t *sm)
+{
+    SH_ASSERT(sched);
+    SH_ASSERT(sm);
+
+    int level = sh_isr_disable();
+    sh_sched_entry_t *entry = SH_MALLOC(sizeof(sh_sched_entry_t));
+    sh_isr_enable(level);
+    if (entry == NULL) {
+        return -1;
+    }
+
+    sh_list_init(&entry->list);
+    sh_list_init(&entry->ready);
+    sh_list_init(&entry->timer);
+    entry->deadline = 0;
+    entry->has_deadline = false;
+    atomic_init(&entry->is_removed, false);
+    atomic_init(&entry->state, SH_SCHED_IDLE);
+    entry->sm = sm;
+    entry->sched = sched;
+
+    pthread_mutex_lock(&sched->lock);
+    sh_list_insert_before(&entry->list, &sched->entry_head);
+    pthread_mutex_unlock(&sched->lock);
+
+    sh_sm_set_notify(sm, sh_sched_notify, entry);
+
+    /* handle what is already pending and pick up the timers */
+    sh_sched_wake(sched, entry, false);
+
+    return 0;
+}
+
+/**
+ * wait until the sm is no longer queued or running, after that the
+ * application may drive or destroy it again.
+ */
+int sh_sched_remove(sh_sched_t *sched, sh_sm_t *sm)
+{
+    SH_ASSERT(sched);
+    SH_ASSERT(sm);
+
+    sh_sched_entry_t *entry = NULL;
+
+    pthread_mutex_lock(&sched->lock);
+    sh_list_for_each(node, &sched->entry_head) {
+        sh_sched_entry_t *_entry = sh_container_of(node, sh_sched_entry_t, list);
+        if (_entry->sm == sm) {
+            entry = _entry;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    sh_sm_set_notify(sm, NULL, NULL);
+
+    pthread_mutex_lock(&sched->lock);
+
+    atomic_store(&entry->is_removed, true);
+    if (entry->has_deadline) {
+        sh_list_remove(&entry->timer);
+        entry->has_deadline = false;
+    }
+
+    /* nothing queues the entry again, so it is in a deque or on a worker */
+    while (atomic_load(&entry->state) != SH_SCHED_IDLE) {
+        if (!sh_sched_unqueue(sched, entry)) {
+            pthread_cond_wait(&sched->cond, &sched->lock);
+        }
+    }
+
+    sh_list_remove(&entry->list);
+
+    pthread_mutex_unlock(&sched->lock);
+
+    int level = sh_isr_disable();
+    SH_FREE(entry);
+    sh_isr_enable(level);
+
+    return 0;
+}
+
+/**
+ * wait until no added sm is queued or running, sms waiting for a timer
+ * count as idle. do not call it from an sm handler.
+ */
+void sh_sched_wait_idle(sh_sched_t *sched)
+{
+    SH_ASSERT(sched);
+
+    pthread_mutex_lock(&sched->lock);
+    while (atomic_load(&sched->busy_cnt) && atomic_load(&sched->is_running)) {
+        pthread_cond_wait(&sched->cond, &sched->lock);
+    }
+    pthread_mutex_unlock(&sched->lock);
+}
+
+/**
+ * the number of times an sm handler was run, idle sms are not run.
+ */
+uint32_t sh_sched_get_run_count(sh_sched_t *sched)
+{
+    SH_ASSERT(sched);
+
+    return atomic_load(&sched->run_cnt);
+}
+
+#endif
@@ -1,3 +1,7 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
 #include "sh_sm.h"
 #include "sh_assert.h"
 #include "sh_lib.h"
@@ -13,40 +17,126 @@
     #define SH_FREE     free
 #endif
 
+/**
+ * a timer id is the pool index of its node in the low 16 bits and the
+ * generation of the node above, so an id that was already removed or
+ * expired never hits a reused node.
+ */
+#define SH_SM_TIMER_ID_INDEX(id)        ((uint32_t)(id) & 0xFFFF)
+#define SH_SM_TIMER_ID(index, gen)      ((sh_sm_timer_id_t)(((uint32_t)(gen) << 16) | (index)))
+#define SH_SM_TIMER_GEN_MASK            0x7FFF
+
+struct sh_sm_timer_ctrl;
+
 typedef struct sh_sm_timer {
     sh_list_t list;
-    sh_timer_t *timer;
+    sh_timer_t timer;
     uint8_t event_id;
     sh_sm_t *sm;
     enum sh_sm_timer_type type;
-    uint8_t timer_id;
-    unsigned int param;
+    struct sh_sm_timer_ctrl *ctrl;
+    uint16_t gen;
+    sh_sm_timer_id_t id;
+    sh_event_param_t param;
 } sh_sm_timer_t;
 
 typedef struct sh_sm_timer_ctrl {
     sh_list_t   timer_head;
-    uint32_t    bitmap;
     sh_list_t   timer_node_head;
 } sh_sm_timer_ctrl_t;
 
 typedef struct sh_sm_state {
-    sh_list_t list;
     uint8_t state_id;
     sh_event_server_t *server;
     sh_sm_timer_ctrl_t timer_ctrl;
+    struct sh_sm_state *parent;
+    uint8_t depth;
+    event_cb *handler;
+    sh_sm_action_fn entry;
+    sh_sm_action_fn exit;
+#if USE_SH_SM_TRACE
+    sh_tick_t residency;
+    sh_tick_t *cb_tick;
+#endif
 } sh_sm_state_t;
 
+#if USE_SH_SM_TRACE
+typedef struct sh_sm_trace {
+    sh_sm_trace_rec_t *ring;
+    uint16_t size;
+    uint16_t head;
+    uint16_t cnt;
+    sh_tick_t enter_tick;
+    sh_tick_t cb_start;
+    uint8_t cb_state;
+    uint8_t cb_event;
+    bool in_cb;
+} sh_sm_trace_t;
+#endif
+
+#define SH_SM_DEF_NO_EVENT      0xFF
+
+struct sh_sm_def {
+    uint8_t state_cnt;
+    uint8_t event_cnt;
+    uint8_t event_index[UINT8_MAX + 1];
+    sh_sm_inst_cb *cb;
+    uint8_t *next;
+    sh_timer_get_tick_fn timer_get_tick;
+};
+
 struct sh_sm {
-    sh_list_t state_head;
+    sh_sm_state_t **state_table;
+    uint16_t timer_cnt;
+    uint16_t state_cap;
     sh_sm_state_t *current_state;
     sh_event_map_t *map;
+    uint8_t *event_id;
     sh_timer_get_tick_fn timer_get_tick;
     sh_sm_timer_ctrl_t timer_ctrl;
+    sh_sm_timer_t *timer_pool;
+    sh_list_t timer_free_head;
+    enum sh_sm_dispatch_mode mode;
+    sh_event_server_t *server;
+    event_cb *cb_table;
+    sh_sm_notify_fn notify;
+    void *notify_arg;
+#if USE_SH_SM_TRACE
+    sh_sm_trace_t *trace;
+#endif
     bool re_execute;
 };
 
+static void sh_sm_timer_overtick_cb(void *param);
+
+static int sh_sm_timer_pool_init(sh_sm_t *sm, uint16_t timer_cnt)
+{
+    sh_list_init(&sm->timer_free_head);
+    sm->timer_cnt = timer_cnt;
+
+    sm->timer_pool = SH_MALLOC(timer_cnt * sizeof(sh_sm_timer_t));
+    if (sm->timer_pool == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < timer_cnt; i++) {
+        sh_sm_timer_t *timer_node = &sm->timer_pool[i];
+
+        sh_timer_init(&timer_node->timer, SH_TIMER_MODE_SINGLE, sh_sm_timer_overtick_cb);
+        sh_timer_set_param(&timer_node->timer, timer_node);
+        timer_node->sm = sm;
+        timer_node->ctrl = NULL;
+        timer_node->gen = 0;
+
+        sh_list_init(&timer_node->list);
+        sh_list_insert_before(&timer_node->list, &sm->timer_free_head);
+    }
+
+    return 0;
+}
+
 static int sh_sm_init(sh_sm_t *sm, uint8_t *event_buf, size_t size, 
-                      sh_timer_get_tick_fn fn)
+                      sh_timer_get_tick_fn fn, uint16_t timer_cnt)
 {
     SH_ASSERT(sm);
     SH_ASSERT(event_buf);
@@ -57,31 +147,61 @@ static int sh_sm_init(sh_sm_t *sm, uint8_t *event_buf, size_t size,
         return -1;
     }
 
+    sm->event_id = SH_MALLOC(size);
+    if (sm->event_id == NULL) {
+        sh_event_map_destroy(map);
+        return -1;
+    }
+    memcpy(sm->event_id, event_buf, size);
+
+    if (sh_sm_timer_pool_init(sm, timer_cnt)) {
+        SH_FREE(sm->event_id);
+        sh_event_map_destroy(map);
+        return -1;
+    }
+
     sm->timer_get_tick = fn;
 
-    sh_list_init(&sm->state_head);
+    sm->state_table = NULL;
+    sm->state_cap = 0;
     sm->current_state = NULL;
     sm->map = map;
+    sm->mode = SH_SM_DISPATCH_SERVER;
+    sm->server = NULL;
+    sm->cb_table = NULL;
+    sm->notify = NULL;
+    sm->notify_arg = NULL;
+#if USE_SH_SM_TRACE
+    sm->trace = NULL;
+#endif
     
     sh_list_init(&sm->timer_ctrl.timer_head);
     sh_list_init(&sm->timer_ctrl.timer_node_head);
-    sm->timer_ctrl.bitmap = 0;
 
     sh_timer_sys_init(fn);
     
     return 0;
 }
 
-sh_sm_t* sh_sm_create(uint8_t *event_buf, size_t size, sh_get_tick_fn fn)
+/**
+ * the event timers of the sm are served from a pool of timer_cnt entries
+ * allocated here, starting and expiring them never allocates memory.
+ */
+sh_sm_t* sh_sm_create_with_timer_pool(uint8_t *event_buf, size_t size, 
+                                      sh_get_tick_fn fn, uint16_t timer_cnt)
 {
     SH_ASSERT(event_buf);
 
+    if (timer_cnt == 0) {
+        return NULL;
+    }
+
     sh_sm_t *sm = SH_MALLOC(sizeof(sh_sm_t));
     if (sm == NULL) {
         return NULL;
     }
 
-    if (sh_sm_init(sm, event_buf, size, fn)) {
+    if (sh_sm_init(sm, event_buf, size, fn, timer_cnt)) {
         SH_FREE(sm);
         sm = NULL;
     }
@@ -89,27 +209,140 @@ sh_sm_t* sh_sm_create(uint8_t *event_buf, size_t size, sh_get_tick_fn fn)
     return sm;
 }
 
+/**
+ * the event timers come from a pool of SH_SM_TIMER_POOL_SIZE entries,
+ * shared by the states and the global timers.
+ */
+sh_sm_t* sh_sm_create(uint8_t *event_buf, size_t size, sh_get_tick_fn fn)
+{
+    return sh_sm_create_with_timer_pool(event_buf, size, fn, SH_SM_TIMER_POOL_SIZE);
+}
+
+/**
+ * SH_SM_DISPATCH_SERVER gives every state its own event server and queue,
+ * pending events of a state are dropped when it is left.
+ *
+ * SH_SM_DISPATCH_TABLE keeps one queue for the sm and a flat
+ * [state][event] callback table, pending events are delivered to the
+ * state that is current when they are handled.
+ *
+ * the mode can only be changed before any state is created.
+ */
+#if USE_SH_SM_TRACE
+static void sh_sm_trace_hook(sh_event_server_t *server, const sh_event_msg_t *e, 
+                             bool is_post, void *arg);
+#endif
+
+int sh_sm_set_dispatch_mode(sh_sm_t *sm, enum sh_sm_dispatch_mode mode)
+{
+    SH_ASSERT(sm);
+
+    if (sm->state_cap) {
+        return -1;
+    }
+
+    if (mode == sm->mode) {
+        return 0;
+    }
+
+    if (mode == SH_SM_DISPATCH_SERVER) {
+        sh_event_server_destroy(sm->server);
+        sm->server = NULL;
+        sm->mode = mode;
+        return 0;
+    }
+
+    if (mode != SH_SM_DISPATCH_TABLE) {
+        return -1;
+    }
+
+    sh_event_server_t *server = sh_event_server_create(sm->map, NULL);
+    if (server == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < sm->map->cnt; i++) {
+        if (sh_event_subscribe(server, sm->event_id[i], NULL)) {
+            sh_event_server_destroy(server);
+            return -1;
+        }
+    }
+
+    sh_event_server_start(server);
+
+    sm->server = server;
+    sm->mode = mode;
+
+#if USE_SH_SM_TRACE
+    if (sm->trace) {
+        sh_event_server_set_hook(server, sh_sm_trace_hook, sm);
+    }
+#endif
+
+    return 0;
+}
+
+static void sh_sm_timer_node_destroy(sh_sm_timer_t *timer_node);
+
+static void sh_sm_remove_ctrl_all_timer(sh_sm_timer_ctrl_t *ctrl)
+{
+    int level = sh_isr_disable();
+
+    sh_list_for_each_safe(node, &ctrl->timer_node_head) {
+        sh_sm_timer_node_destroy(sh_container_of(node, sh_sm_timer_t, list));
+    }
+
+    sh_isr_enable(level);
+}
+
 static void _sh_sm_remove_state_all_timer(sh_sm_t *sm, sh_sm_state_t *state)
 {
     SH_ASSERT(sm);
     SH_ASSERT(state);
 
-    for (int i = 0; i < (sizeof(state->timer_ctrl.bitmap) * 8); i++) {
-        if (state->timer_ctrl.bitmap & (1ul << i)) {
-            sh_sm_remove_timer(sm, SH_SM_PRIVATE_TIMER, i);
-        }
+    sh_sm_remove_ctrl_all_timer(&state->timer_ctrl);
+}
+
+static event_cb* sh_sm_table_row(sh_sm_t *sm, uint8_t state_id)
+{
+    return &sm->cb_table[state_id * sm->map->cnt];
+}
+
+/**
+ * in table mode the sm server dispatches through the callback row of
+ * the current state, switching state is a single pointer write. without
+ * a current state the server falls back to its own empty callbacks.
+ */
+static void sh_sm_table_select(sh_sm_t *sm)
+{
+    if (sm->mode != SH_SM_DISPATCH_TABLE) {
+        return;
+    }
+
+    if (sm->current_state) {
+        sh_event_server_set_cb_table(sm->server, sh_sm_table_row(sm, sm->current_state->state_id));
+    } else {
+        sh_event_server_set_cb_table(sm->server, NULL);
     }
 }
 
-static int sh_sm_remove_state_node(sh_sm_state_t *state)
+static int sh_sm_remove_state_node(sh_sm_t *sm, sh_sm_state_t *state)
 {
     SH_ASSERT(state);
 
-    sh_list_remove(&state->list);
+    sm->state_table[state->state_id] = NULL;
+
+    if (sm->current_state == state) {
+        sm->current_state = NULL;
+        sh_sm_table_select(sm);
+    }
 
     return 0;
 }
 
+static void sh_sm_state_update_depth(sh_sm_t *sm);
+static void sh_sm_state_refresh(sh_sm_t *sm, sh_sm_state_t *state, int index);
+
 static void _sh_sm_state_destroy(sh_sm_t *sm, sh_sm_state_t *state)
 {
     SH_ASSERT(sm);
@@ -121,8 +354,24 @@ static void _sh_sm_state_destroy(sh_sm_t *sm, sh_sm_state_t *state)
 
     _sh_sm_remove_state_all_timer(sm, state);
 
-    sh_sm_remove_state_node(state);
+    sh_sm_remove_state_node(sm, state);
+
+    /* the children become top level states */
+    for (int i = 0; i < sm->state_cap; i++) {
+        sh_sm_state_t *child = sm->state_table[i];
+        if (child && (child->parent == state)) {
+            child->parent = NULL;
+            sh_sm_state_update_depth(sm);
+            sh_sm_state_refresh(sm, child, -1);
+        }
+    }
 
+#if USE_SH_SM_TRACE
+    if (state->cb_tick) {
+        SH_FREE(state->cb_tick);
+    }
+#endif
+    SH_FREE(state->handler);
     SH_FREE(state);
 }
 
@@ -130,29 +379,117 @@ void sh_sm_destroy(sh_sm_t *sm)
 {
     SH_ASSERT(sm);
 
-    sh_list_for_each_safe(node, &sm->state_head) {
-        sh_sm_state_t *state = sh_container_of(node, sh_sm_state_t, list);
-        _sh_sm_state_destroy(sm, state);
+#if USE_SH_SM_TRACE
+    sh_sm_trace_disable(sm);
+#endif
+
+    for (int i = 0; i < sm->state_cap; i++) {
+        if (sm->state_table[i]) {
+            _sh_sm_state_destroy(sm, sm->state_table[i]);
+        }
+    }
+    if (sm->state_table) {
+        SH_FREE(sm->state_table);
+    }
+    if (sm->server) {
+        sh_event_server_destroy(sm->server);
+    }
+    if (sm->cb_table) {
+        SH_FREE(sm->cb_table);
     }
     sh_event_map_destroy(sm->map);
+    SH_FREE(sm->event_id);
     sh_sm_remove_all_global_timer(sm);
 
+    if (sm->timer_pool) {
+        SH_FREE(sm->timer_pool);
+    }
     SH_FREE(sm);
 }
 
 
-static int sh_sm_state_init(sh_sm_state_t *state, 
+static int sh_sm_state_init(sh_sm_t *sm,
+                            sh_sm_state_t *state, 
                             sh_event_server_t *server, 
-                            uint8_t state_id)
+                            uint8_t state_id,
+                            event_cb *handler,
+                            uint8_t event_cnt)
 {
     SH_ASSERT(state);
 
-    sh_list_init(&state->list);
     sh_list_init(&state->timer_ctrl.timer_head);
     sh_list_init(&state->timer_ctrl.timer_node_head);
     state->server = server;
     state->state_id = state_id;
-    state->timer_ctrl.bitmap = 0;
+    state->parent = NULL;
+    state->depth = 0;
+    state->handler = handler;
+    state->entry = NULL;
+    state->exit = NULL;
+#if USE_SH_SM_TRACE
+    state->residency = 0;
+    state->cb_tick = NULL;
+#endif
+
+    for (int i = 0; i < event_cnt; i++) {
+        state->handler[i] = NULL;
+        if (sm->mode == SH_SM_DISPATCH_TABLE) {
+            sh_sm_table_row(sm, state_id)[i] = NULL;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * the states are indexed by state_id, the table grows to the largest id.
+ */
+static int sh_sm_state_table_reserve(sh_sm_t *sm, uint8_t state_id)
+{
+    SH_ASSERT(sm);
+
+    if (state_id < sm->state_cap) {
+        return 0;
+    }
+
+    uint16_t cap = state_id + 1;
+    sh_sm_state_t **table = SH_MALLOC(cap * sizeof(sh_sm_state_t*));
+    if (table == NULL) {
+        return -1;
+    }
+
+    event_cb *cb_table = NULL;
+    if (sm->mode == SH_SM_DISPATCH_TABLE) {
+        cb_table = SH_MALLOC(cap * sm->map->cnt * sizeof(event_cb));
+        if (cb_table == NULL) {
+            SH_FREE(table);
+            return -1;
+        }
+
+        for (int i = 0; i < (cap * sm->map->cnt); i++) {
+            cb_table[i] = (i < (sm->state_cap * sm->map->cnt)) ? sm->cb_table[i] : NULL;
+        }
+    }
+
+    for (int i = 0; i < cap; i++) {
+        table[i] = (i < sm->state_cap) ? sm->state_table[i] : NULL;
+    }
+
+    if (sm->state_table) {
+        SH_FREE(sm->state_table);
+    }
+
+    sm->state_table = table;
+    sm->state_cap = cap;
+
+    if (cb_table) {
+        event_cb *old_table = sm->cb_table;
+        sm->cb_table = cb_table;
+        sh_sm_table_select(sm);
+        if (old_table) {
+            SH_FREE(old_table);
+        }
+    }
 
     return 0;
 }
@@ -162,34 +499,65 @@ static int sh_sm_add_state(sh_sm_t *sm, sh_sm_state_t *state)
     SH_ASSERT(sm);
     SH_ASSERT(state);
 
-    sh_list_insert_before(&state->list, &sm->state_head);
+    sm->state_table[state->state_id] = state;
     
     return 0;
 }
 
+#if USE_SH_SM_TRACE
+static int sh_sm_trace_state_attach(sh_sm_t *sm, sh_sm_state_t *state);
+#endif
+
 int sh_sm_state_create(sh_sm_t *sm, uint8_t state_id)
 {
     SH_ASSERT(sm);
     SH_ASSERT(sm->map);
 
-    sh_event_server_t *server = sh_event_server_create(sm->map, NULL);
-    if (server == NULL) {
+    if (sh_sm_state_table_reserve(sm, state_id)) {
+        return -1;
+    }
+
+    if (sm->state_table[state_id]) {
         return -1;
     }
 
+    sh_event_server_t *server = NULL;
+    if (sm->mode == SH_SM_DISPATCH_SERVER) {
+        server = sh_event_server_create(sm->map, NULL);
+        if (server == NULL) {
+            return -1;
+        }
+    }
+
+    event_cb *handler = SH_MALLOC(sm->map->cnt * sizeof(event_cb));
+    if (handler == NULL) {
+        goto free_server;
+    }
+
     sh_sm_state_t *state = SH_MALLOC(sizeof(sh_sm_state_t));
     if (state == NULL) {
-        goto free_server;
+        goto free_handler;
     }
 
-    sh_sm_state_init(state, server, state_id);
+    sh_sm_state_init(sm, state, server, state_id, handler, sm->map->cnt);
+
+#if USE_SH_SM_TRACE
+    if (sm->trace && sh_sm_trace_state_attach(sm, state)) {
+        SH_FREE(state);
+        goto free_handler;
+    }
+#endif
 
     sh_sm_add_state(sm, state);
 
     return 0;
 
+free_handler:
+    SH_FREE(handler);
 free_server:
-    sh_event_server_destroy(server);
+    if (server) {
+        sh_event_server_destroy(server);
+    }
 
     return -1;
 }
@@ -198,14 +566,11 @@ static sh_sm_state_t* sh_sm_get_state(sh_sm_t *sm, uint8_t state_id)
 {
     SH_ASSERT(sm);
 
-    sh_list_for_each(node, &sm->state_head) {
-        sh_sm_state_t *state = sh_container_of(node, sh_sm_state_t, list);
-        if (state->state_id == state_id) {
-            return state;
-        }
+    if (state_id >= sm->state_cap) {
+        return NULL;
     }
 
-    return NULL;
+    return sm->state_table[state_id];
 }
 
 int sh_sm_state_destroy(sh_sm_t *sm, uint8_t state_id)
@@ -222,6 +587,97 @@ int sh_sm_state_destroy(sh_sm_t *sm, uint8_t state_id)
     return 0;
 }
 
+static int sh_sm_get_event_index(sh_sm_t *sm, uint8_t event_id)
+{
+    for (int i = 0; i < sm->map->cnt; i++) {
+        if (sm->event_id[i] == event_id) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static bool sh_sm_state_is_descendant(sh_sm_state_t *state, sh_sm_state_t *ancestor)
+{
+    for (; state; state = state->parent) {
+        if (state == ancestor) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * an event that a state does not handle bubbles up to its parent. the
+ * bubbling is resolved here, every state server (or table row) gets the
+ * callback of the nearest state in its ancestor chain that handles the
+ * event, so dispatch still costs a single lookup.
+ */
+static int sh_sm_state_apply(sh_sm_t *sm, sh_sm_state_t *state, int index)
+{
+    event_cb cb = NULL;
+    uint8_t event_id = sm->event_id[index];
+
+    for (sh_sm_state_t *_state = state; _state; _state = _state->parent) {
+        if (_state->handler[index]) {
+            cb = _state->handler[index];
+            break;
+        }
+    }
+
+    if (sm->mode == SH_SM_DISPATCH_TABLE) {
+        sh_sm_table_row(sm, state->state_id)[index] = cb;
+        return 0;
+    }
+
+    sh_event_unsubscribe(state->server, event_id);
+
+    if (cb == NULL) {
+        return 0;
+    }
+
+    return sh_event_subscribe(state->server, event_id, cb);
+}
+
+/**
+ * re-apply the event at index, or every event if index < 0, to state and
+ * all of its descendants.
+ */
+static void sh_sm_state_refresh(sh_sm_t *sm, sh_sm_state_t *state, int index)
+{
+    for (int i = 0; i < sm->state_cap; i++) {
+        sh_sm_state_t *_state = sm->state_table[i];
+        if (!_state || !sh_sm_state_is_descendant(_state, state)) {
+            continue;
+        }
+
+        if (index >= 0) {
+            sh_sm_state_apply(sm, _state, index);
+            continue;
+        }
+
+        for (int j = 0; j < sm->map->cnt; j++) {
+            sh_sm_state_apply(sm, _state, j);
+        }
+    }
+}
+
+static int sh_sm_state_set_handler(sh_sm_t *sm, sh_sm_state_t *state, 
+                                   uint8_t event_id, event_cb cb)
+{
+    int index = sh_sm_get_event_index(sm, event_id);
+    if (index < 0) {
+        return -1;
+    }
+
+    state->handler[index] = cb;
+    sh_sm_state_refresh(sm, state, index);
+
+    return 0;
+}
+
 int sh_sm_state_subscribe_event(sh_sm_t *sm, uint8_t state_id, uint8_t event_id, event_cb cb)
 {
     SH_ASSERT(sm);
@@ -231,7 +687,7 @@ int sh_sm_state_subscribe_event(sh_sm_t *sm, uint8_t state_id, uint8_t event_id,
         return -1;
     }
 
-    return sh_event_subscribe(state->server, event_id, cb);
+    return sh_sm_state_set_handler(sm, state, event_id, cb);
 }
 
 int sh_sm_state_subscribe_events(sh_sm_t *sm, uint8_t state_id, uint8_t *event_buf, 
@@ -245,7 +701,7 @@ int sh_sm_state_subscribe_events(sh_sm_t *sm, uint8_t state_id, uint8_t *event_b
     }
 
     for (int i = 0; i < event_cnt; i++) {
-        if (sh_event_subscribe(state->server, event_buf[i], cb)) {
+        if (sh_sm_state_set_handler(sm, state, event_buf[i], cb)) {
             return -1;
         }
     }
@@ -262,81 +718,354 @@ int sh_sm_state_unsubscribe_event(sh_sm_t *sm, uint8_t state_id, uint8_t event_i
         return -1;
     }
 
-    return sh_event_unsubscribe(state->server, event_id);
+    return sh_sm_state_set_handler(sm, state, event_id, NULL);
 }
 
-int sh_sm_trans_to(sh_sm_t *sm, uint8_t state_id)
+static void sh_sm_state_update_depth(sh_sm_t *sm)
 {
-    SH_ASSERT(sm);
-
-    sh_sm_state_t *to_state = sh_sm_get_state(sm, state_id);
-    if (to_state == NULL) {
-        return -1;
-    }
+    for (int i = 0; i < sm->state_cap; i++) {
+        sh_sm_state_t *state = sm->state_table[i];
+        if (state == NULL) {
+            continue;
+        }
 
-    if (sm->current_state) {
-        sh_event_server_t *server = sm->current_state->server;
-        sh_event_server_stop(server);
-        sh_event_server_clear_msg(server);
-        
-        _sh_sm_remove_state_all_timer(sm, sm->current_state);
+        state->depth = 0;
+        for (sh_sm_state_t *_state = state->parent; _state; _state = _state->parent) {
+            state->depth++;
+        }
     }
-
-    sm->current_state = to_state;
-    sh_event_server_start(sm->current_state->server);
-
-    sm->re_execute = true;
-
-    return 0;
 }
 
-int sh_sm_handler(sh_sm_t *sm)
+/**
+ * make parent_id the parent state of state_id, events that state_id does
+ * not handle are handled by its ancestors.
+ */
+int sh_sm_state_set_parent(sh_sm_t *sm, uint8_t state_id, uint8_t parent_id)
 {
-    sh_event_server_t *server = NULL;
+    SH_ASSERT(sm);
 
-    if (sm == NULL) {
+    sh_sm_state_t *state = sh_sm_get_state(sm, state_id);
+    sh_sm_state_t *parent = sh_sm_get_state(sm, parent_id);
+    if ((state == NULL) || (parent == NULL)) {
         return -1;
     }
 
-    if (sm->current_state == NULL) {
+    /* no loop and no chain deeper than SH_SM_DEPTH_MAX */
+    if (sh_sm_state_is_descendant(parent, state)) {
         return -1;
     }
 
-execute_handler:
-    server = sm->current_state->server;
-    if (server == NULL) {
+    uint8_t max_depth = 0;
+    for (int i = 0; i < sm->state_cap; i++) {
+        sh_sm_state_t *_state = sm->state_table[i];
+        if (_state && sh_sm_state_is_descendant(_state, state)) {
+            max_depth = MAX(max_depth, (uint8_t)(_state->depth - state->depth));
+        }
+    }
+    if ((parent->depth + 1 + max_depth) >= SH_SM_DEPTH_MAX) {
         return -1;
     }
 
-    sh_timer_handler(&sm->timer_ctrl.timer_head);
-    sh_timer_handler(&sm->current_state->timer_ctrl.timer_head);
-    sh_event_handler(server);
-
-    if (sm->re_execute) {
-        sm->re_execute = false;
-        goto execute_handler;
-    }
+    state->parent = parent;
+    sh_sm_state_update_depth(sm);
+    sh_sm_state_refresh(sm, state, -1);
 
     return 0;
 }
 
-int sh_sm_publish_event(sh_sm_t *sm, uint8_t event_id)
+int sh_sm_state_set_action(sh_sm_t *sm, uint8_t state_id, 
+                           sh_sm_action_fn entry, sh_sm_action_fn exit)
 {
     SH_ASSERT(sm);
-    SH_ASSERT(sm->map);
 
-    return sh_event_publish(sm->map, event_id);
-}
+    sh_sm_state_t *state = sh_sm_get_state(sm, state_id);
+    if (state == NULL) {
+        return -1;
+    }
 
-int sh_sm_publish_event_with_param(sh_sm_t *sm, uint8_t event_id, unsigned int param)
-{
-    SH_ASSERT(sm);
-    SH_ASSERT(sm->map);
+    state->entry = entry;
+    state->exit = exit;
 
-    return sh_event_publish_with_param(sm->map, event_id, NULL, param);
+    return 0;
 }
 
-static void sh_sm_timer_node_destroy(sh_sm_timer_t *timer_node)
+static sh_sm_state_t* sh_sm_get_lca(sh_sm_state_t *from, sh_sm_state_t *to)
+{
+    /**
+     * a self transition exits and re-enters the state, a transition to an
+     * ancestor or a descendant is local and keeps the outer state active.
+     */
+    if (from == to) {
+        return to->parent;
+    }
+
+    while (from && to && (from != to)) {
+        if (from->depth >= to->depth) {
+            from = from->parent;
+        } else {
+            to = to->parent;
+        }
+    }
+
+    return (from == to) ? from : NULL;
+}
+
+#if USE_SH_SM_TRACE
+static void sh_sm_trace_trans(sh_sm_t *sm, sh_sm_state_t *from, sh_sm_state_t *to);
+#endif
+
+int sh_sm_trans_to(sh_sm_t *sm, uint8_t state_id)
+{
+    SH_ASSERT(sm);
+
+    sh_sm_state_t *path[SH_SM_DEPTH_MAX];
+    int path_cnt = 0;
+
+    sh_sm_state_t *to_state = sh_sm_get_state(sm, state_id);
+    if (to_state == NULL) {
+        return -1;
+    }
+
+    sh_sm_state_t *from_state = sm->current_state;
+    sh_sm_state_t *lca = from_state ? sh_sm_get_lca(from_state, to_state) : NULL;
+
+#if USE_SH_SM_TRACE
+    sh_sm_trace_trans(sm, from_state, to_state);
+#endif
+
+    if (from_state) {
+        sh_event_server_t *server = from_state->server;
+        if (server) {
+            sh_event_server_stop(server);
+            sh_event_server_clear_msg(server);
+        }
+        
+        _sh_sm_remove_state_all_timer(sm, from_state);
+
+        for (sh_sm_state_t *state = from_state; state != lca; state = state->parent) {
+            if (state->exit) {
+                state->exit(sm, state->state_id);
+            }
+        }
+    }
+
+    sm->current_state = to_state;
+    if (sm->mode == SH_SM_DISPATCH_TABLE) {
+        sh_sm_table_select(sm);
+    } else {
+        sh_event_server_start(sm->current_state->server);
+    }
+
+    for (sh_sm_state_t *state = to_state; state != lca; state = state->parent) {
+        path[path_cnt++] = state;
+    }
+    while (path_cnt > 0) {
+        sh_sm_state_t *state = path[--path_cnt];
+        if (state->entry) {
+            state->entry(sm, state->state_id);
+        }
+    }
+
+    sm->re_execute = true;
+
+    return 0;
+}
+
+int sh_sm_handler(sh_sm_t *sm)
+{
+    sh_event_server_t *server = NULL;
+
+    if (sm == NULL) {
+        return -1;
+    }
+
+    if (sm->current_state == NULL) {
+        return -1;
+    }
+
+execute_handler:
+    server = sm->server ? sm->server : sm->current_state->server;
+    if (server == NULL) {
+        return -1;
+    }
+
+    sh_timer_handler(&sm->timer_ctrl.timer_head);
+    sh_timer_handler(&sm->current_state->timer_ctrl.timer_head);
+    sh_event_handler(server);
+
+    if (sm->re_execute) {
+        sm->re_execute = false;
+        goto execute_handler;
+    }
+
+    return 0;
+}
+
+/**
+ * fn is called whenever the sm may have new work, an event was published
+ * or a timer was started. a scheduler uses it to run the sm only when
+ * needed, fn may be called from any thread and from within the handler.
+ */
+void sh_sm_set_notify(sh_sm_t *sm, sh_sm_notify_fn fn, void *arg)
+{
+    SH_ASSERT(sm);
+
+    int level = sh_isr_disable();
+
+    sm->notify = fn;
+    sm->notify_arg = arg;
+
+    sh_isr_enable(level);
+}
+
+/**
+ * fn runs with the isr lock held, once sh_sm_set_notify() returns the old
+ * fn is no longer running and will not be called again.
+ */
+static void sh_sm_notify(sh_sm_t *sm)
+{
+    int level = sh_isr_disable();
+
+    if (sm->notify) {
+        sm->notify(sm, sm->notify_arg);
+    }
+
+    sh_isr_enable(level);
+}
+
+/**
+ * get the ticks until the next timer of the sm expires, the global timers
+ * and the timers of the current state are taken into account.
+ * return -1 if no timer is running.
+ */
+int sh_sm_next_deadline(sh_sm_t *sm, sh_tick_t *ticks_until)
+{
+    SH_ASSERT(sm);
+    SH_ASSERT(ticks_until);
+
+    int ret = -1;
+    sh_tick_t _ticks_until = 0;
+
+    int level = sh_isr_disable();
+
+    sh_tick_t now = sm->timer_get_tick();
+
+    if (sh_timer_next_expiry(&sm->timer_ctrl.timer_head, now, &_ticks_until) == 0) {
+        *ticks_until = _ticks_until;
+        ret = 0;
+    }
+
+    if (sm->current_state && 
+        (sh_timer_next_expiry(&sm->current_state->timer_ctrl.timer_head, 
+                              now, &_ticks_until) == 0)) {
+        if ((ret < 0) || (_ticks_until < *ticks_until)) {
+            *ticks_until = _ticks_until;
+        }
+        ret = 0;
+    }
+
+    sh_isr_enable(level);
+
+    return ret;
+}
+
+/**
+ * check whether sh_sm_handler() has anything to do now, a queued event
+ * or a timer that is due.
+ */
+bool sh_sm_has_work(sh_sm_t *sm)
+{
+    SH_ASSERT(sm);
+
+    bool has_work = false;
+    sh_tick_t ticks_until = 0;
+
+    int level = sh_isr_disable();
+
+    sh_event_server_t *server = sm->server;
+    if ((server == NULL) && sm->current_state) {
+        server = sm->current_state->server;
+    }
+
+    if (server && (sh_event_server_get_msg_count(server) > 0)) {
+        has_work = true;
+    } else if ((sh_sm_next_deadline(sm, &ticks_until) == 0) && (ticks_until == 0)) {
+        has_work = true;
+    }
+
+    sh_isr_enable(level);
+
+    return has_work;
+}
+
+/**
+ * block in fn until the sm has work. fn gets the ticks until the next
+ * timer is due, SH_SM_WAIT_FOREVER if none is running, and returns early
+ * when the notify fn of the sm wakes it. the wakeup must be latched, e.g.
+ * a semaphore or an eventfd, since an event may arrive before fn blocks.
+ */
+int sh_sm_wait(sh_sm_t *sm, sh_sm_wait_fn fn, void *arg)
+{
+    SH_ASSERT(sm);
+    SH_ASSERT(fn);
+
+    sh_tick_t ticks_until = 0;
+
+    if (sh_sm_has_work(sm)) {
+        return 0;
+    }
+
+    if (sh_sm_next_deadline(sm, &ticks_until)) {
+        ticks_until = SH_SM_WAIT_FOREVER;
+    }
+
+    fn(sm, ticks_until, arg);
+
+    return 0;
+}
+
+int sh_sm_publish_event(sh_sm_t *sm, uint8_t event_id)
+{
+    SH_ASSERT(sm);
+    SH_ASSERT(sm->map);
+
+    int ret = sh_event_publish(sm->map, event_id);
+    if (ret == 0) {
+        sh_sm_notify(sm);
+    }
+
+    return ret;
+}
+
+int sh_sm_publish_event_with_param(sh_sm_t *sm, uint8_t event_id, unsigned int param)
+{
+    sh_event_param_t _param = {
+        .u32 = param,
+    };
+
+    return sh_sm_publish_event_with_typed_param(sm, event_id, &_param);
+}
+
+/**
+ * the param travels inline in the message, read it back in the callback
+ * with sh_sm_get_event_typed_param().
+ */
+int sh_sm_publish_event_with_typed_param(sh_sm_t *sm, uint8_t event_id, 
+                                         const sh_event_param_t *param)
+{
+    SH_ASSERT(sm);
+    SH_ASSERT(sm->map);
+    SH_ASSERT(param);
+
+    int ret = sh_event_publish_with_typed_param(sm->map, event_id, param);
+    if (ret == 0) {
+        sh_sm_notify(sm);
+    }
+
+    return ret;
+}
+
+static void sh_sm_timer_node_destroy(sh_sm_timer_t *timer_node)
 {
     if (timer_node == NULL) {
         return;
@@ -344,13 +1073,15 @@ static void sh_sm_timer_node_destroy(sh_sm_timer_t *timer_node)
 
     int level = sh_isr_disable();
 
+    sh_sm_t *sm = timer_node->sm;
+
+    sh_timer_stop(&timer_node->timer);
     sh_list_remove(&timer_node->list);
 
-    if (timer_node->timer) {
-        sh_timer_destroy(timer_node->timer);
-    }
+    timer_node->ctrl = NULL;
+    timer_node->gen = (timer_node->gen + 1) & SH_SM_TIMER_GEN_MASK;
 
-    SH_FREE(timer_node);
+    sh_list_insert_before(&timer_node->list, &sm->timer_free_head);
     
     sh_isr_enable(level);
 }
@@ -363,70 +1094,71 @@ static void sh_sm_timer_overtick_cb(void *param)
 
     sh_sm_timer_t *timer_node = (sh_sm_timer_t*)param;
 
-    sh_sm_publish_event_with_param(timer_node->sm, timer_node->event_id, timer_node->param);
+    sh_sm_publish_event_with_typed_param(timer_node->sm, timer_node->event_id, 
+                                         &timer_node->param);
 
-    sh_sm_remove_timer(timer_node->sm, timer_node->type, timer_node->timer_id);
+    sh_sm_timer_node_destroy(timer_node);
 
     sh_isr_enable(level);
 }
 
-static sh_sm_timer_t* sh_sm_timer_node_create(void)
+static sh_sm_timer_t* sh_sm_timer_node_create(sh_sm_t *sm, sh_sm_timer_ctrl_t *ctrl)
 {
-    sh_sm_timer_t *timer_node = SH_MALLOC(sizeof(sh_sm_timer_t));
-    if (timer_node == NULL) {
+    if (sh_list_isempty(&sm->timer_free_head)) {
         return NULL;
     }
 
-    sh_timer_t *timer = sh_timer_create(SH_TIMER_MODE_SINGLE, sh_sm_timer_overtick_cb);
-    if (timer == NULL) {
-        goto free_timer_node;
-    }
-    
-    timer_node->timer = timer;
+    sh_sm_timer_t *timer_node = 
+        sh_container_of(sm->timer_free_head.next, sh_sm_timer_t, list);
 
-    return timer_node;
+    sh_list_remove(&timer_node->list);
 
-free_timer_node:
-    SH_FREE(timer_node);
+    timer_node->id = SH_SM_TIMER_ID(timer_node - sm->timer_pool, timer_node->gen);
+    timer_node->ctrl = ctrl;
 
-    return NULL;
+    return timer_node;
 }
 
-static int sh_sm_timer_get_uniqe_id(uint32_t bitmap)
+/**
+ * the node of timer_id if it is still running in ctrl, NULL if it has
+ * expired, was removed or belongs to another state.
+ */
+static sh_sm_timer_t* sh_sm_timer_node_find(sh_sm_t *sm, sh_sm_timer_ctrl_t *ctrl, 
+                                            sh_sm_timer_id_t timer_id)
 {
-    for (int i = 0; i < (sizeof(bitmap) * 8); i++) {
-        if (!(bitmap & (1ul << i))) {
-            return i;
-        }
+    uint32_t index = SH_SM_TIMER_ID_INDEX(timer_id);
+
+    if ((ctrl == NULL) || (index >= sm->timer_cnt)) {
+        return NULL;
     }
 
-    return -1;
+    sh_sm_timer_t *timer_node = &sm->timer_pool[index];
+
+    return ((timer_node->ctrl == ctrl) && (timer_node->id == timer_id)) ? timer_node : NULL;
 }
 
-static int _sh_sm_start_timer(sh_sm_t *sm, uint8_t event_id, uint8_t timer_id,
-                              sh_sm_timer_ctrl_t *ctrl, uint32_t interval_tick,
-                              unsigned int param)
+static sh_sm_timer_id_t _sh_sm_start_timer(sh_sm_t *sm, uint8_t event_id,
+                                           sh_sm_timer_ctrl_t *ctrl, sh_tick_t interval_tick,
+                                           const sh_event_param_t *param)
 {
     int level = sh_isr_disable();
 
-    sh_sm_timer_t *timer_node = sh_sm_timer_node_create();
+    sh_sm_timer_t *timer_node = sh_sm_timer_node_create(sm, ctrl);
     if (timer_node == NULL) {
         sh_isr_enable(level);
         return -1;
     }
 
-    timer_node->sm = sm;
     timer_node->event_id = event_id;
-    timer_node->timer_id = timer_id;
-    timer_node->param = param;
+    if (param) {
+        timer_node->param = *param;
+    } else {
+        memset(&timer_node->param, 0, sizeof(sh_event_param_t));
+    }
     timer_node->type = ((ctrl == &sm->timer_ctrl) ?
                         SH_SM_GLOBAL_TIMER : SH_SM_PRIVATE_TIMER);
 
-    sh_list_init(&timer_node->list);
-
-    sh_timer_set_param(timer_node->timer, timer_node);
-
-    if (sh_timer_start(timer_node->timer, &ctrl->timer_head, 
+    if (sh_timer_start(&timer_node->timer, &ctrl->timer_head, 
                        sm->timer_get_tick(), interval_tick))
     {
         sh_sm_timer_node_destroy(timer_node);
@@ -435,46 +1167,26 @@ static int _sh_sm_start_timer(sh_sm_t *sm, uint8_t event_id, uint8_t timer_id,
     }
 
     sh_list_insert_before(&timer_node->list, &ctrl->timer_node_head);
-    sh_isr_enable(level);
-    
-    return 0;
-}
-
-static int sh_sm_start_timer_and_get_id(sh_sm_t *sm, sh_sm_timer_ctrl_t *ctrl,
-                                        uint32_t interval_tick, uint8_t event_id,
-                                        unsigned int param)
-{
-    SH_ASSERT(sm);
-    
-    int level = sh_isr_disable();
-    
-    int timer_id = sh_sm_timer_get_uniqe_id(ctrl->bitmap);
-    if (timer_id < 0) {
-        sh_isr_enable(level);
-        return -1;
-    }
 
-    if (_sh_sm_start_timer(sm, event_id, timer_id, ctrl, interval_tick, param)) {
-        sh_isr_enable(level);
-        return -1;
-    }
+    sh_sm_timer_id_t timer_id = timer_node->id;
 
-    ctrl->bitmap |= (1ul << timer_id);
     sh_isr_enable(level);
 
+    sh_sm_notify(sm);
+    
     return timer_id;
 }
 
-int sh_sm_start_global_timer(sh_sm_t *sm, uint32_t interval_tick, uint8_t event_id)
+sh_sm_timer_id_t sh_sm_start_global_timer(sh_sm_t *sm, sh_tick_t interval_tick, uint8_t event_id)
 {
     SH_ASSERT(sm);
     
     sh_sm_timer_ctrl_t *ctrl = &sm->timer_ctrl;
 
-    return sh_sm_start_timer_and_get_id(sm, ctrl, interval_tick, event_id, 0);
+    return _sh_sm_start_timer(sm, event_id, ctrl, interval_tick, NULL);
 }
 
-int sh_sm_start_timer(sh_sm_t *sm, uint32_t interval_tick, uint8_t event_id)
+sh_sm_timer_id_t sh_sm_start_timer(sh_sm_t *sm, sh_tick_t interval_tick, uint8_t event_id)
 {
     SH_ASSERT(sm);
     
@@ -484,13 +1196,24 @@ int sh_sm_start_timer(sh_sm_t *sm, uint32_t interval_tick, uint8_t event_id)
 
     sh_sm_timer_ctrl_t *ctrl = &sm->current_state->timer_ctrl;
 
-    return sh_sm_start_timer_and_get_id(sm, ctrl, interval_tick, event_id, 0);
+    return _sh_sm_start_timer(sm, event_id, ctrl, interval_tick, NULL);
+}
+
+sh_sm_timer_id_t sh_sm_start_timer_with_param(sh_sm_t *sm, sh_tick_t interval_tick, 
+                                              uint8_t event_id, unsigned int param)
+{
+    sh_event_param_t _param = {
+        .u32 = param,
+    };
+
+    return sh_sm_start_timer_with_typed_param(sm, interval_tick, event_id, &_param);
 }
 
-int sh_sm_start_timer_with_param(sh_sm_t *sm, uint32_t interval_tick, 
-                                 uint8_t event_id, unsigned int param)
+sh_sm_timer_id_t sh_sm_start_timer_with_typed_param(sh_sm_t *sm, sh_tick_t interval_tick, 
+                                                    uint8_t event_id, const sh_event_param_t *param)
 {
     SH_ASSERT(sm);
+    SH_ASSERT(param);
     
     if (sm->current_state == NULL) {
         return -1;
@@ -498,7 +1221,7 @@ int sh_sm_start_timer_with_param(sh_sm_t *sm, uint32_t interval_tick,
 
     sh_sm_timer_ctrl_t *ctrl = &sm->current_state->timer_ctrl;
 
-    return sh_sm_start_timer_and_get_id(sm, ctrl, interval_tick, event_id, param);
+    return _sh_sm_start_timer(sm, event_id, ctrl, interval_tick, param);
 }
 
 static sh_list_t* sh_sm_get_global_timer_head(sh_sm_t *sm)
@@ -510,7 +1233,7 @@ static sh_list_t* sh_sm_get_global_timer_head(sh_sm_t *sm)
     return &sm->timer_ctrl.timer_head;
 }
 
-sh_timer_t* sh_sm_start_normal_timer(sh_sm_t *sm, uint32_t interval_tick, overtick_cb_fn cb)
+sh_timer_t* sh_sm_start_normal_timer(sh_sm_t *sm, sh_tick_t interval_tick, overtick_cb_fn cb)
 {
     if (sm == NULL) {
         return NULL;
@@ -528,77 +1251,41 @@ sh_timer_t* sh_sm_start_normal_timer(sh_sm_t *sm, uint32_t interval_tick, overti
         return NULL;
     }
 
-    return timer;
-}
-
-static int sh_sm_timer_destroy(sh_list_t *timer_node_head, uint8_t timer_id)
-{
-    SH_ASSERT(timer_node_head);
-
-    sh_list_for_each(node, timer_node_head) {
-        sh_sm_timer_t *timer_node = sh_container_of(node, sh_sm_timer_t, list);
-        if (timer_node->timer_id == timer_id) {
-            sh_sm_timer_node_destroy(timer_node);
-            return 0;
-        }
-    }
+    sh_sm_notify(sm);
 
-    return -1;
+    return timer;
 }
 
-static int sh_sm_get_bitmap_and_timer_head(sh_sm_t *sm, 
-                                           enum sh_sm_timer_type type, 
-                                           uint32_t **bitmap, 
-                                           sh_list_t **timer_node_head)
+static sh_sm_timer_ctrl_t* sh_sm_get_timer_ctrl(sh_sm_t *sm, enum sh_sm_timer_type type)
 {
-    sh_sm_timer_ctrl_t *ctrl = NULL;
-    
     if (type == SH_SM_PRIVATE_TIMER) {
-        if (!sm->current_state) {
-            return -1;
-        }
-        ctrl = &sm->current_state->timer_ctrl;
+        return sm->current_state ? &sm->current_state->timer_ctrl : NULL;
     } else if (type == SH_SM_GLOBAL_TIMER) {
-        ctrl = &sm->timer_ctrl;
-    } else {
-        return -1;
+        return &sm->timer_ctrl;
     }
 
-    *bitmap = &ctrl->bitmap;
-    *timer_node_head = &ctrl->timer_node_head;
-
-    return 0;
+    return NULL;
 }
 
-int sh_sm_remove_timer(sh_sm_t *sm, enum sh_sm_timer_type type, uint8_t timer_id)
+int sh_sm_remove_timer(sh_sm_t *sm, enum sh_sm_timer_type type, sh_sm_timer_id_t timer_id)
 {
     SH_ASSERT(sm);
 
-    uint32_t *bitmap_ptr = NULL;
-    sh_list_t *timer_node_head = NULL;
-
-    int level = sh_isr_disable();
-
-    /* timer id is too large */
-    if (timer_id >= (uint8_t)(sizeof(sm->timer_ctrl.bitmap) * 8)) {
-        sh_isr_enable(level);
+    if (timer_id < 0) {
         return -1;
     }
 
-    if (sh_sm_get_bitmap_and_timer_head(sm, type, &bitmap_ptr, &timer_node_head)) {
-        sh_isr_enable(level);
-        return -1;
-    }
+    int level = sh_isr_disable();
 
-    /* timer id does not exist in the bitmap */
-    if ((*bitmap_ptr & (1ul << timer_id)) == 0) {
+    sh_sm_timer_t *timer_node = 
+        sh_sm_timer_node_find(sm, sh_sm_get_timer_ctrl(sm, type), timer_id);
+    if (timer_node == NULL) {
         sh_isr_enable(level);
         return -1;
     }
 
-    if (sh_sm_timer_destroy(timer_node_head, timer_id) == 0) {
-        *bitmap_ptr &= (~(1ul << timer_id));
-    }
+    sh_sm_timer_node_destroy(timer_node);
+
     sh_isr_enable(level);
 
     return 0;
@@ -622,17 +1309,947 @@ void sh_sm_remove_all_global_timer(sh_sm_t *sm)
 {
     SH_ASSERT(sm);
 
-    for (int i = 0; i < (sizeof(sm->timer_ctrl.bitmap) * 8); i++) {
-        if (sm->timer_ctrl.bitmap & (1ul << i)) {
-            sh_sm_remove_timer(sm, SH_SM_GLOBAL_TIMER, i);
-        }
-    }
+    sh_sm_remove_ctrl_all_timer(&sm->timer_ctrl);
 }
 
 unsigned int sh_sm_get_event_param(const sh_event_msg_t *msg)
 {
-    return msg->size;
+    return msg->param.u32;
+}
+
+const sh_event_param_t* sh_sm_get_event_typed_param(const sh_event_msg_t *msg)
+{
+    return &msg->param;
+}
+
+/**
+ * snapshot layout, host byte order:
+ *   magic(4) version(1) tick size(1) state(1) timer cnt(2) event cnt(2)
+ *   timer: type(1) event(1) remaining ticks(tick size) param
+ *   event: id(1) param data size(4) data
+ */
+#define SH_SM_SNAPSHOT_MAGIC        0x4D534853
+#define SH_SM_SNAPSHOT_VERSION      1
+
+typedef struct sh_sm_blob {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+} sh_sm_blob_t;
+
+typedef struct sh_sm_snapshot_timer {
+    uint8_t type;
+    uint8_t event_id;
+    sh_tick_t remain;
+    sh_event_param_t param;
+} sh_sm_snapshot_timer_t;
+
+static void sh_sm_blob_put(sh_sm_blob_t *blob, const void *data, size_t n)
+{
+    if (blob->buf && (blob->len + n <= blob->size)) {
+        memcpy(blob->buf + blob->len, data, n);
+    }
+
+    blob->len += n;
+}
+
+static int sh_sm_blob_get(sh_sm_blob_t *blob, void *data, size_t n)
+{
+    if (blob->size - blob->len < n) {
+        return -1;
+    }
+
+    if (data) {
+        memcpy(data, blob->buf + blob->len, n);
+    }
+
+    blob->len += n;
+
+    return 0;
 }
 
+static uint16_t sh_sm_timer_ctrl_count(sh_sm_timer_ctrl_t *ctrl)
+{
+    uint16_t cnt = 0;
+
+    sh_list_for_each(node, &ctrl->timer_node_head) {
+        cnt++;
+    }
 
+    return cnt;
+}
 
+static void sh_sm_snapshot_put_timers(sh_sm_blob_t *blob, sh_sm_timer_ctrl_t *ctrl,
+                                      sh_tick_t now)
+{
+    sh_list_for_each(node, &ctrl->timer_node_head) {
+        sh_sm_timer_t *timer_node = sh_container_of(node, sh_sm_timer_t, list);
+        uint8_t type = (uint8_t)timer_node->type;
+        sh_tick_t remain = 0;
+
+        if (!sh_timer_is_time_out(now, timer_node->timer.overtick)) {
+            remain = timer_node->timer.overtick - now;
+        }
+
+        sh_sm_blob_put(blob, &type, sizeof(type));
+        sh_sm_blob_put(blob, &timer_node->event_id, sizeof(timer_node->event_id));
+        sh_sm_blob_put(blob, &remain, sizeof(remain));
+        sh_sm_blob_put(blob, &timer_node->param, sizeof(timer_node->param));
+    }
+}
+
+static int sh_sm_snapshot_put_msg(const sh_event_msg_t *e, void *arg)
+{
+    sh_sm_blob_t *blob = (sh_sm_blob_t*)arg;
+    uint32_t size = e->data ? (uint32_t)e->size : 0;
+
+    sh_sm_blob_put(blob, &e->id, sizeof(e->id));
+    sh_sm_blob_put(blob, &e->param, sizeof(e->param));
+    sh_sm_blob_put(blob, &size, sizeof(size));
+    if (size) {
+        sh_sm_blob_put(blob, e->data, size);
+    }
+
+    return 0;
+}
+
+/**
+ * write the current state, the pending pool timers as remaining ticks and
+ * the queued events of sm to buf. timers of sh_sm_start_normal_timer() are
+ * not included and pointer params are stored as they are.
+ * with buf NULL only the needed size is returned.
+ * return the snapshot length, -1 if buf is too small.
+ */
+int sh_sm_snapshot(sh_sm_t *sm, uint8_t *buf, size_t size)
+{
+    SH_ASSERT(sm);
+
+    sh_sm_blob_t blob = {buf, size, 0};
+    uint32_t magic = SH_SM_SNAPSHOT_MAGIC;
+    uint8_t version = SH_SM_SNAPSHOT_VERSION;
+    uint8_t tick_size = sizeof(sh_tick_t);
+    uint8_t state_id = SH_SM_STATE_NONE;
+    uint16_t timer_cnt = 0;
+    uint16_t event_cnt = 0;
+
+    int level = sh_isr_disable();
+
+    sh_sm_state_t *state = sm->current_state;
+    sh_event_server_t *server = sm->server ? sm->server : (state ? state->server : NULL);
+    sh_tick_t now = sm->timer_get_tick();
+
+    timer_cnt = sh_sm_timer_ctrl_count(&sm->timer_ctrl);
+    if (state) {
+        state_id = state->state_id;
+        timer_cnt += sh_sm_timer_ctrl_count(&state->timer_ctrl);
+    }
+    if (server) {
+        event_cnt = (uint16_t)sh_event_server_get_msg_count(server);
+    }
+
+    sh_sm_blob_put(&blob, &magic, sizeof(magic));
+    sh_sm_blob_put(&blob, &version, sizeof(version));
+    sh_sm_blob_put(&blob, &tick_size, sizeof(tick_size));
+    sh_sm_blob_put(&blob, &state_id, sizeof(state_id));
+    sh_sm_blob_put(&blob, &timer_cnt, sizeof(timer_cnt));
+    sh_sm_blob_put(&blob, &event_cnt, sizeof(event_cnt));
+
+    sh_sm_snapshot_put_timers(&blob, &sm->timer_ctrl, now);
+    if (state) {
+        sh_sm_snapshot_put_timers(&blob, &state->timer_ctrl, now);
+    }
+    if (server) {
+        sh_event_server_for_each_msg(server, sh_sm_snapshot_put_msg, &blob);
+    }
+
+    sh_isr_enable(level);
+
+    if (buf && (blob.len > size)) {
+        return -1;
+    }
+
+    return (int)blob.len;
+}
+
+static int sh_sm_blob_get_timer(sh_sm_blob_t *blob, sh_sm_snapshot_timer_t *timer)
+{
+    if (sh_sm_blob_get(blob, &timer->type, sizeof(timer->type)) ||
+        sh_sm_blob_get(blob, &timer->event_id, sizeof(timer->event_id)) ||
+        sh_sm_blob_get(blob, &timer->remain, sizeof(timer->remain)) ||
+        sh_sm_blob_get(blob, &timer->param, sizeof(timer->param))) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* msg->data points into the blob */
+static int sh_sm_blob_get_msg(sh_sm_blob_t *blob, sh_event_msg_t *msg)
+{
+    uint32_t size = 0;
+
+    if (sh_sm_blob_get(blob, &msg->id, sizeof(msg->id)) ||
+        sh_sm_blob_get(blob, &msg->param, sizeof(msg->param)) ||
+        sh_sm_blob_get(blob, &size, sizeof(size))) {
+        return -1;
+    }
+
+    msg->data = size ? (blob->buf + blob->len) : NULL;
+    msg->size = size;
+
+    return sh_sm_blob_get(blob, NULL, size);
+}
+
+/**
+ * load a snapshot of sh_sm_snapshot() into an sm built with the same
+ * states and subscriptions, so a restart does not have to replay events.
+ * the pending timers and events of sm are dropped, the state is set
+ * without running entry or exit actions and the timers get new ids.
+ * a snapshot that does not fit sm is rejected before sm is changed.
+ */
+int sh_sm_restore(sh_sm_t *sm, const uint8_t *buf, size_t size)
+{
+    SH_ASSERT(sm);
+    SH_ASSERT(buf);
+
+    sh_sm_blob_t blob = {(uint8_t*)buf, size, 0};
+    uint32_t magic = 0;
+    uint8_t version = 0;
+    uint8_t tick_size = 0;
+    uint8_t state_id = SH_SM_STATE_NONE;
+    uint16_t timer_cnt = 0;
+    uint16_t event_cnt = 0;
+    sh_sm_snapshot_timer_t timer;
+    sh_event_msg_t msg;
+    sh_sm_state_t *state = NULL;
+    int ret = 0;
+
+    if (sh_sm_blob_get(&blob, &magic, sizeof(magic)) ||
+        sh_sm_blob_get(&blob, &version, sizeof(version)) ||
+        sh_sm_blob_get(&blob, &tick_size, sizeof(tick_size)) ||
+        sh_sm_blob_get(&blob, &state_id, sizeof(state_id)) ||
+        sh_sm_blob_get(&blob, &timer_cnt, sizeof(timer_cnt)) ||
+        sh_sm_blob_get(&blob, &event_cnt, sizeof(event_cnt))) {
+        return -1;
+    }
+
+    if ((magic != SH_SM_SNAPSHOT_MAGIC) || (version != SH_SM_SNAPSHOT_VERSION) ||
+        (tick_size != sizeof(sh_tick_t)) || (timer_cnt > sm->timer_cnt)) {
+        return -1;
+    }
+
+    if (state_id != SH_SM_STATE_NONE) {
+        state = sh_sm_get_state(sm, state_id);
+        if (state == NULL) {
+            return -1;
+        }
+    }
+
+    size_t offset = blob.len;
+
+    for (int i = 0; i < timer_cnt; i++) {
+        if (sh_sm_blob_get_timer(&blob, &timer)) {
+            return -1;
+        }
+
+        if (sh_sm_get_event_index(sm, timer.event_id) < 0) {
+            return -1;
+        }
+
+        if ((timer.type != SH_SM_GLOBAL_TIMER) && 
+            ((timer.type != SH_SM_PRIVATE_TIMER) || (state == NULL))) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < event_cnt; i++) {
+        if (sh_sm_blob_get_msg(&blob, &msg)) {
+            return -1;
+        }
+    }
+
+    if (blob.len != size) {
+        return -1;
+    }
+
+    sh_event_server_t *server = sm->server ? sm->server : (state ? state->server : NULL);
+    if (event_cnt && (server == NULL)) {
+        return -1;
+    }
+
+    blob.len = offset;
+
+    int level = sh_isr_disable();
+
+    sh_sm_remove_ctrl_all_timer(&sm->timer_ctrl);
+    if (sm->current_state) {
+        _sh_sm_remove_state_all_timer(sm, sm->current_state);
+        if (sm->current_state->server) {
+            sh_event_server_stop(sm->current_state->server);
+            sh_event_server_clear_msg(sm->current_state->server);
+        }
+    }
+    if (sm->server) {
+        sh_event_server_clear_msg(sm->server);
+    }
+
+#if USE_SH_SM_TRACE
+    if (state) {
+        sh_sm_trace_trans(sm, sm->current_state, state);
+    }
+#endif
+
+    sm->current_state = state;
+    if (sm->mode == SH_SM_DISPATCH_TABLE) {
+        sh_sm_table_select(sm);
+    } else if (state) {
+        sh_event_server_start(state->server);
+    }
+
+    for (int i = 0; i < timer_cnt; i++) {
+        sh_sm_blob_get_timer(&blob, &timer);
+
+        sh_sm_timer_ctrl_t *ctrl = (timer.type == SH_SM_GLOBAL_TIMER) ?
+                                   &sm->timer_ctrl : &state->timer_ctrl;
+
+        /* a timer that was already due fires on the next handler run */
+        if (_sh_sm_start_timer(sm, timer.event_id, ctrl, 
+                               timer.remain ? timer.remain : 1, &timer.param) < 0) {
+            ret = -1;
+        }
+    }
+
+    for (int i = 0; i < event_cnt; i++) {
+        sh_sm_blob_get_msg(&blob, &msg);
+
+        if (sh_event_post_msg(server, &msg)) {
+            ret = -1;
+        }
+    }
+
+    sm->re_execute = true;
+
+    sh_isr_enable(level);
+
+    sh_sm_notify(sm);
+
+    return ret;
+}
+
+/**
+ * a definition holds everything the instances share: an event id to
+ * event index table, a [state][event] callback table and a [state][event]
+ * next state table. the handler of an instance finds the row of a message
+ * without searching the event ids.
+ */
+sh_sm_def_t* sh_sm_def_create(uint8_t state_cnt, uint8_t *event_buf, 
+                              size_t size, sh_get_tick_fn fn)
+{
+    SH_ASSERT(event_buf);
+    SH_ASSERT(fn);
+
+    if ((state_cnt == 0) || (state_cnt >= SH_SM_STATE_NONE) || 
+        (size == 0) || (size > UINT8_MAX)) {
+        return NULL;
+    }
+
+    sh_sm_def_t *def = SH_MALLOC(sizeof(sh_sm_def_t));
+    if (def == NULL) {
+        return NULL;
+    }
+
+    uint32_t cnt = state_cnt * size;
+
+    def->cb = SH_MALLOC(cnt * sizeof(sh_sm_inst_cb));
+    if (def->cb == NULL) {
+        goto free_def;
+    }
+
+    def->next = SH_MALLOC(cnt);
+    if (def->next == NULL) {
+        goto free_cb;
+    }
+
+    for (uint32_t i = 0; i < cnt; i++) {
+        def->cb[i] = NULL;
+        def->next[i] = SH_SM_STATE_NONE;
+    }
+
+    /* size is below SH_SM_DEF_NO_EVENT, the first of duplicate ids wins */
+    memset(def->event_index, SH_SM_DEF_NO_EVENT, sizeof(def->event_index));
+    for (uint32_t i = size; i > 0; i--) {
+        def->event_index[event_buf[i - 1]] = (uint8_t)(i - 1);
+    }
+
+    def->state_cnt = state_cnt;
+    def->event_cnt = size;
+    def->timer_get_tick = fn;
+
+    sh_timer_sys_init(fn);
+
+    return def;
+
+free_cb:
+    SH_FREE(def->cb);
+free_def:
+    SH_FREE(def);
+
+    return NULL;
+}
+
+void sh_sm_def_destroy(sh_sm_def_t *def)
+{
+    if (def == NULL) {
+        return;
+    }
+
+    SH_FREE(def->next);
+    SH_FREE(def->cb);
+    SH_FREE(def);
+}
+
+static int sh_sm_def_get_index(const sh_sm_def_t *def, uint8_t state_id, uint8_t event_id)
+{
+    uint8_t index = def->event_index[event_id];
+
+    if ((state_id >= def->state_cnt) || (index == SH_SM_DEF_NO_EVENT)) {
+        return -1;
+    }
+
+    return state_id * def->event_cnt + index;
+}
+
+int sh_sm_def_subscribe_event(sh_sm_def_t *def, uint8_t state_id, 
+                              uint8_t event_id, sh_sm_inst_cb cb)
+{
+    SH_ASSERT(def);
+
+    int index = sh_sm_def_get_index(def, state_id, event_id);
+    if (index < 0) {
+        return -1;
+    }
+
+    def->cb[index] = cb;
+
+    return 0;
+}
+
+/**
+ * once the callback of event_id has run, an instance in state_id moves
+ * to next_state_id. SH_SM_STATE_NONE removes the transition.
+ */
+int sh_sm_def_add_transition(sh_sm_def_t *def, uint8_t state_id, 
+                             uint8_t event_id, uint8_t next_state_id)
+{
+    SH_ASSERT(def);
+
+    int index = sh_sm_def_get_index(def, state_id, event_id);
+    if (index < 0) {
+        return -1;
+    }
+
+    if ((next_state_id != SH_SM_STATE_NONE) && (next_state_id >= def->state_cnt)) {
+        return -1;
+    }
+
+    def->next[index] = next_state_id;
+
+    return 0;
+}
+
+static void sh_sm_inst_timer_cb(void *param)
+{
+    SH_ASSERT(param);
+
+    sh_sm_inst_t *inst = (sh_sm_inst_t*)param;
+
+    sh_sm_inst_publish_event(inst, inst->timer_event_id, 0);
+}
+
+/**
+ * the queue lives in queue_buf, which holds queue_size messages. the
+ * definition must outlive the instance.
+ */
+int sh_sm_inst_init(sh_sm_inst_t *inst, const sh_sm_def_t *def, 
+                    sh_event_msg_t *queue_buf, uint32_t queue_size, 
+                    uint8_t state_id)
+{
+    SH_ASSERT(inst);
+    SH_ASSERT(def);
+    SH_ASSERT(queue_buf);
+
+    if ((state_id >= def->state_cnt) || (queue_size < 2)) {
+        return -1;
+    }
+
+    inst->def = def;
+    inst->state = state_id;
+    inst->timer_event_id = 0;
+
+    sh_fifo_init(&inst->queue, queue_buf, queue_size, sizeof(sh_event_msg_t));
+
+    sh_timer_init(&inst->timer, SH_TIMER_MODE_SINGLE, sh_sm_inst_timer_cb);
+    sh_timer_set_param(&inst->timer, inst);
+
+    return 0;
+}
+
+/**
+ * allocate the instance and its queue in one block.
+ */
+sh_sm_inst_t* sh_sm_inst_create(const sh_sm_def_t *def, uint32_t queue_size, uint8_t state_id)
+{
+    SH_ASSERT(def);
+
+    sh_sm_inst_t *inst = SH_MALLOC(sizeof(sh_sm_inst_t) + queue_size * sizeof(sh_event_msg_t));
+    if (inst == NULL) {
+        return NULL;
+    }
+
+    if (sh_sm_inst_init(inst, def, (sh_event_msg_t*)(inst + 1), queue_size, state_id)) {
+        SH_FREE(inst);
+        return NULL;
+    }
+
+    return inst;
+}
+
+void sh_sm_inst_deinit(sh_sm_inst_t *inst)
+{
+    SH_ASSERT(inst);
+
+    sh_timer_stop(&inst->timer);
+}
+
+void sh_sm_inst_destroy(sh_sm_inst_t *inst)
+{
+    if (inst == NULL) {
+        return;
+    }
+
+    sh_sm_inst_deinit(inst);
+    SH_FREE(inst);
+}
+
+/**
+ * leaving a state stops the state timer, queued events are kept and
+ * handled in the new state.
+ */
+int sh_sm_inst_trans_to(sh_sm_inst_t *inst, uint8_t state_id)
+{
+    SH_ASSERT(inst);
+
+    if (state_id >= inst->def->state_cnt) {
+        return -1;
+    }
+
+    sh_timer_stop(&inst->timer);
+    inst->state = state_id;
+
+    return 0;
+}
+
+int sh_sm_inst_publish_event(sh_sm_inst_t *inst, uint8_t event_id, unsigned int param)
+{
+    SH_ASSERT(inst);
+
+    sh_event_msg_t msg = {
+        .id = event_id,
+        .data = NULL,
+        .size = 0,
+        .param.u32 = param,
+    };
+
+    return (sh_fifo_in(&inst->queue, &msg, 1) == 1) ? 0 : -1;
+}
+
+int sh_sm_inst_start_timer(sh_sm_inst_t *inst, sh_list_t *head, 
+                           sh_tick_t interval_tick, uint8_t event_id)
+{
+    SH_ASSERT(inst);
+    SH_ASSERT(head);
+
+    int level = sh_isr_disable();
+
+    inst->timer_event_id = event_id;
+    int ret = sh_timer_start(&inst->timer, head, 
+                             inst->def->timer_get_tick(), interval_tick);
+
+    sh_isr_enable(level);
+
+    return ret;
+}
+
+void sh_sm_inst_stop_timer(sh_sm_inst_t *inst)
+{
+    SH_ASSERT(inst);
+
+    sh_timer_stop(&inst->timer);
+}
+
+/**
+ * the state timers are served by calling sh_timer_handler() on the list
+ * passed to sh_sm_inst_start_timer(), usually one list for all instances.
+ * a row that leaves the state stops the state timer before its callback
+ * runs, so the callback can arm the timer of the next state.
+ */
+int sh_sm_inst_handler(sh_sm_inst_t *inst)
+{
+    SH_ASSERT(inst);
+
+    const sh_sm_def_t *def = inst->def;
+    sh_event_msg_t msg;
+
+    while (sh_fifo_out(&inst->queue, &msg, 1)) {
+        int index = sh_sm_def_get_index(def, inst->state, msg.id);
+        if (index < 0) {
+            continue;
+        }
+
+        uint8_t next = def->next[index];
+
+        if (next != SH_SM_STATE_NONE) {
+            sh_timer_stop(&inst->timer);
+        }
+
+        if (def->cb[index]) {
+            def->cb[index](inst, &msg);
+        }
+
+        if (next != SH_SM_STATE_NONE) {
+            inst->state = next;
+        }
+    }
+
+    return 0;
+}
+
+#if USE_SH_SM_TRACE
+static void sh_sm_trace_record(sh_sm_trace_t *trace, const sh_sm_trace_rec_t *rec)
+{
+    trace->ring[trace->head] = *rec;
+    trace->head = (trace->head + 1) % trace->size;
+
+    if (trace->cnt < trace->size) {
+        trace->cnt++;
+    }
+}
+
+static void sh_sm_trace_trans(sh_sm_t *sm, sh_sm_state_t *from, sh_sm_state_t *to)
+{
+    sh_sm_trace_t *trace = sm->trace;
+    if (trace == NULL) {
+        return;
+    }
+
+    int level = sh_isr_disable();
+
+    sh_tick_t now = sm->timer_get_tick();
+
+    if (from) {
+        from->residency += now - trace->enter_tick;
+    }
+    trace->enter_tick = now;
+
+    sh_sm_trace_rec_t rec = {
+        .tick = now,
+        .dur = 0,
+        .type = SH_SM_TRACE_TRANS,
+        .from = from ? from->state_id : SH_SM_STATE_NONE,
+        .to = to->state_id,
+        .event = trace->in_cb ? trace->cb_event : SH_SM_TRACE_NO_EVENT,
+    };
+    sh_sm_trace_record(trace, &rec);
+
+    sh_isr_enable(level);
+}
+
+static void sh_sm_trace_hook(sh_event_server_t *server, const sh_event_msg_t *e, 
+                             bool is_post, void *arg)
+{
+    sh_sm_t *sm = (sh_sm_t*)arg;
+    sh_sm_trace_t *trace = sm->trace;
+    if (trace == NULL) {
+        return;
+    }
+
+    (void)server;
+
+    int level = sh_isr_disable();
+
+    sh_tick_t now = sm->timer_get_tick();
+
+    if (!is_post) {
+        trace->cb_start = now;
+        trace->cb_state = sm->current_state ? sm->current_state->state_id : SH_SM_STATE_NONE;
+        trace->cb_event = e->id;
+        trace->in_cb = true;
+        sh_isr_enable(level);
+        return;
+    }
+
+    trace->in_cb = false;
+
+    sh_sm_state_t *state = sh_sm_get_state(sm, trace->cb_state);
+    int index = sh_sm_get_event_index(sm, e->id);
+    if (state && state->cb_tick && (index >= 0)) {
+        state->cb_tick[index] += now - trace->cb_start;
+    }
+
+    sh_sm_trace_rec_t rec = {
+        .tick = trace->cb_start,
+        .dur = now - trace->cb_start,
+        .type = SH_SM_TRACE_EVENT,
+        .from = trace->cb_state,
+        .to = sm->current_state ? sm->current_state->state_id : SH_SM_STATE_NONE,
+        .event = e->id,
+    };
+    sh_sm_trace_record(trace, &rec);
+
+    sh_isr_enable(level);
+}
+
+static int sh_sm_trace_state_attach(sh_sm_t *sm, sh_sm_state_t *state)
+{
+    state->cb_tick = SH_MALLOC(sm->map->cnt * sizeof(sh_tick_t));
+    if (state->cb_tick == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < sm->map->cnt; i++) {
+        state->cb_tick[i] = 0;
+    }
+    state->residency = 0;
+
+    if (state->server) {
+        sh_event_server_set_hook(state->server, sh_sm_trace_hook, sm);
+    }
+
+    return 0;
+}
+
+static void sh_sm_trace_state_detach(sh_sm_state_t *state)
+{
+    if (state->server) {
+        sh_event_server_set_hook(state->server, NULL, NULL);
+    }
+
+    if (state->cb_tick) {
+        SH_FREE(state->cb_tick);
+        state->cb_tick = NULL;
+    }
+}
+
+/**
+ * keep the last ring_size transitions and callbacks of the sm, and sum up
+ * the time spent in every state and in every (state, event) callback.
+ * enabling it again restarts the trace.
+ */
+int sh_sm_trace_enable(sh_sm_t *sm, uint16_t ring_size)
+{
+    SH_ASSERT(sm);
+
+    if (ring_size == 0) {
+        return -1;
+    }
+
+    sh_sm_trace_disable(sm);
+
+    sh_sm_trace_t *trace = SH_MALLOC(sizeof(sh_sm_trace_t));
+    if (trace == NULL) {
+        return -1;
+    }
+
+    trace->ring = SH_MALLOC(ring_size * sizeof(sh_sm_trace_rec_t));
+    if (trace->ring == NULL) {
+        SH_FREE(trace);
+        return -1;
+    }
+
+    trace->size = ring_size;
+    trace->head = 0;
+    trace->cnt = 0;
+    trace->enter_tick = sm->timer_get_tick();
+    trace->in_cb = false;
+
+    for (int i = 0; i < sm->state_cap; i++) {
+        if (sm->state_table[i] && sh_sm_trace_state_attach(sm, sm->state_table[i])) {
+            goto detach_state;
+        }
+    }
+
+    if (sm->server) {
+        sh_event_server_set_hook(sm->server, sh_sm_trace_hook, sm);
+    }
+
+    sm->trace = trace;
+
+    return 0;
+
+detach_state:
+    for (int i = 0; i < sm->state_cap; i++) {
+        if (sm->state_table[i]) {
+            sh_sm_trace_state_detach(sm->state_table[i]);
+        }
+    }
+    SH_FREE(trace->ring);
+    SH_FREE(trace);
+
+    return -1;
+}
+
+void sh_sm_trace_disable(sh_sm_t *sm)
+{
+    SH_ASSERT(sm);
+
+    if (sm->trace == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < sm->state_cap; i++) {
+        if (sm->state_table[i]) {
+            sh_sm_trace_state_detach(sm->state_table[i]);
+        }
+    }
+
+    if (sm->server) {
+        sh_event_server_set_hook(sm->server, NULL, NULL);
+    }
+
+    SH_FREE(sm->trace->ring);
+    SH_FREE(sm->trace);
+    sm->trace = NULL;
+}
+
+uint16_t sh_sm_trace_get_count(sh_sm_t *sm)
+{
+    SH_ASSERT(sm);
+
+    return sm->trace ? sm->trace->cnt : 0;
+}
+
+/**
+ * index 0 is the oldest record still in the ring.
+ */
+int sh_sm_trace_get(sh_sm_t *sm, uint16_t index, sh_sm_trace_rec_t *rec)
+{
+    SH_ASSERT(sm);
+    SH_ASSERT(rec);
+
+    sh_sm_trace_t *trace = sm->trace;
+    if ((trace == NULL) || (index >= trace->cnt)) {
+        return -1;
+    }
+
+    *rec = trace->ring[(trace->head + trace->size - trace->cnt + index) % trace->size];
+
+    return 0;
+}
+
+sh_tick_t sh_sm_trace_get_residency(sh_sm_t *sm, uint8_t state_id)
+{
+    SH_ASSERT(sm);
+
+    sh_sm_state_t *state = sh_sm_get_state(sm, state_id);
+    if ((sm->trace == NULL) || (state == NULL)) {
+        return 0;
+    }
+
+    sh_tick_t residency = state->residency;
+    if (state == sm->current_state) {
+        residency += sm->timer_get_tick() - sm->trace->enter_tick;
+    }
+
+    return residency;
+}
+
+sh_tick_t sh_sm_trace_get_cb_tick(sh_sm_t *sm, uint8_t state_id, uint8_t event_id)
+{
+    SH_ASSERT(sm);
+
+    sh_sm_state_t *state = sh_sm_get_state(sm, state_id);
+    int index = sh_sm_get_event_index(sm, event_id);
+    if ((state == NULL) || (state->cb_tick == NULL) || (index < 0)) {
+        return 0;
+    }
+
+    return state->cb_tick[index];
+}
+
+static int sh_sm_trace_append(char *buf, size_t size, size_t *len, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    int ret = vsnprintf(buf + *len, size - *len, fmt, ap);
+    va_end(ap);
+
+    if ((ret < 0) || ((size_t)ret >= (size - *len))) {
+        return -1;
+    }
+
+    *len += ret;
+
+    return 0;
+}
+
+/**
+ * write the ring as chrome trace-event json (chrome://tracing, perfetto).
+ * states are spans on thread 0, transitions are instants on thread 0 and
+ * callbacks are spans on thread 1. tick_us converts ticks to microseconds.
+ * return the length of the json, or -1 if buf is too small.
+ */
+int sh_sm_trace_export(sh_sm_t *sm, char *buf, size_t size, uint32_t tick_us)
+{
+    SH_ASSERT(sm);
+    SH_ASSERT(buf);
+
+    size_t len = 0;
+    const char *sep = "";
+    sh_sm_trace_rec_t rec;
+    sh_tick_t enter_tick = 0;
+    bool has_enter = false;
+
+    if (sh_sm_trace_append(buf, size, &len, "{\"traceEvents\":[")) {
+        return -1;
+    }
+
+    for (uint16_t i = 0; sh_sm_trace_get(sm, i, &rec) == 0; i++) {
+        unsigned long long ts = (unsigned long long)rec.tick * tick_us;
+        unsigned long long dur = (unsigned long long)rec.dur * tick_us;
+        int ret = 0;
+
+        if (rec.type == SH_SM_TRACE_EVENT) {
+            ret = sh_sm_trace_append(buf, size, &len, 
+                "%s{\"name\":\"state %u event %u\",\"ph\":\"X\",\"ts\":%llu,"
+                "\"dur\":%llu,\"pid\":0,\"tid\":1}", sep, rec.from, rec.event, ts, dur);
+            sep = ",";
+        } else {
+            if (has_enter && (rec.from != SH_SM_STATE_NONE)) {
+                unsigned long long enter_ts = (unsigned long long)enter_tick * tick_us;
+                ret |= sh_sm_trace_append(buf, size, &len, 
+                    "%s{\"name\":\"state %u\",\"ph\":\"X\",\"ts\":%llu,"
+                    "\"dur\":%llu,\"pid\":0,\"tid\":0}", 
+                    sep, rec.from, enter_ts, ts - enter_ts);
+                sep = ",";
+            }
+            ret |= sh_sm_trace_append(buf, size, &len, 
+                "%s{\"name\":\"%u -> %u\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,"
+                "\"pid\":0,\"tid\":0}", sep, rec.from, rec.to, ts);
+            sep = ",";
+            enter_tick = rec.tick;
+            has_enter = true;
+        }
+
+        if (ret) {
+            return -1;
+        }
+    }
+
+    if (sh_sm_trace_append(buf, size, &len, "]}")) {
+        return -1;
+    }
+
+    return (int)len;
+}
+#endif
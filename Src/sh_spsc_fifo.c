@@ -0,0 +1,192 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include "sh_assert.h"
+#include "sh_spsc_fifo.h"
+#include "sh_lib.h"
+
+#ifndef SH_MALLOC
+    #define SH_MALLOC   malloc
+#endif
+
+#ifndef SH_FREE
+    #define SH_FREE     free
+#endif
+
+/**
+ * the indices are plain uint32_t so the struct can be public to C++ as
+ * well, they are accessed with the builtins <stdatomic.h> is built on.
+ */
+#define sh_spsc_load(ptr, order)            __atomic_load_n((ptr), (order))
+#define sh_spsc_store(ptr, value, order)    __atomic_store_n((ptr), (value), (order))
+
+static bool sh_spsc_fifo_is_power_of_2(uint32_t n)
+{
+    return (n != 0) && ((n & (n - 1)) == 0);
+}
+
+/**
+ * set up fifo on a caller buffer of size * esize bytes, nothing is
+ * allocated and the fifo is not passed to sh_spsc_fifo_destroy().
+ */
+int sh_spsc_fifo_init(sh_spsc_fifo_t *fifo, void *data, uint32_t size, uint32_t esize)
+{
+    SH_ASSERT(fifo);
+    SH_ASSERT(data);
+
+    if (!sh_spsc_fifo_is_power_of_2(size) || (esize == 0)) {
+        return -1;
+    }
+
+    memset(fifo, 0, sizeof(sh_spsc_fifo_t));
+    fifo->mask  = size - 1;
+    fifo->esize = esize;
+    fifo->data  = data;
+
+    return 0;
+}
+
+sh_spsc_fifo_t* sh_spsc_fifo_create(uint32_t size, uint32_t esize)
+{
+    if (!sh_spsc_fifo_is_power_of_2(size) || (esize == 0)) {
+        return NULL;
+    }
+
+    sh_spsc_fifo_t *fifo = SH_MALLOC(sizeof(sh_spsc_fifo_t));
+    if (fifo == NULL) {
+        return NULL;
+    }
+
+    void *data = SH_MALLOC(size * esize);
+    if (data == NULL) {
+        SH_FREE(fifo);
+        return NULL;
+    }
+
+    sh_spsc_fifo_init(fifo, data, size, esize);
+
+    return fifo;
+}
+
+void sh_spsc_fifo_destroy(sh_spsc_fifo_t *fifo)
+{
+    if (fifo == NULL) {
+        return;
+    }
+
+    SH_FREE(fifo->data);
+    SH_FREE(fifo);
+}
+
+uint32_t sh_spsc_fifo_get_used_size(sh_spsc_fifo_t *fifo)
+{
+    SH_ASSERT(fifo);
+
+    uint32_t out = sh_spsc_load(&fifo->out, __ATOMIC_ACQUIRE);
+    uint32_t in = sh_spsc_load(&fifo->in, __ATOMIC_ACQUIRE);
+
+    return in - out;
+}
+
+uint32_t sh_spsc_fifo_get_unused_size(sh_spsc_fifo_t *fifo)
+{
+    SH_ASSERT(fifo);
+
+    return (fifo->mask + 1) - sh_spsc_fifo_get_used_size(fifo);
+}
+
+static void sh_spsc_fifo_copy_in(sh_spsc_fifo_t *fifo, uint32_t in, 
+                                 const void *buf, uint32_t size)
+{
+    uint32_t esize = fifo->esize;
+    uint32_t off = in & fifo->mask;
+    uint32_t _len = MIN(fifo->mask + 1 - off, size);
+
+    memcpy(fifo->data + off * esize, buf, _len * esize);
+    memcpy(fifo->data, (const uint8_t *)buf + _len * esize, (size - _len) * esize);
+}
+
+static void sh_spsc_fifo_copy_out(sh_spsc_fifo_t *fifo, uint32_t out, 
+                                  void *buf, uint32_t size)
+{
+    uint32_t esize = fifo->esize;
+    uint32_t off = out & fifo->mask;
+    uint32_t _len = MIN(fifo->mask + 1 - off, size);
+
+    memcpy(buf, fifo->data + off * esize, _len * esize);
+    memcpy((uint8_t *)buf + _len * esize, fifo->data, (size - _len) * esize);
+}
+
+/**
+ * the out index of the consumer is only loaded when the cached copy does
+ * not leave enough room.
+ */
+uint32_t sh_spsc_fifo_in(sh_spsc_fifo_t *fifo, const void *buf, uint32_t size)
+{
+    SH_ASSERT(fifo);
+    SH_ASSERT(buf);
+
+    uint32_t in = sh_spsc_load(&fifo->in, __ATOMIC_RELAXED);
+    uint32_t unused_size = (fifo->mask + 1) - (in - fifo->out_cache);
+
+    if (size > unused_size) {
+        fifo->out_cache = sh_spsc_load(&fifo->out, __ATOMIC_ACQUIRE);
+        unused_size = (fifo->mask + 1) - (in - fifo->out_cache);
+        if (size > unused_size) {
+            size = unused_size;
+        }
+    }
+
+    if (size == 0) {
+        return 0;
+    }
+
+    sh_spsc_fifo_copy_in(fifo, in, buf, size);
+
+    sh_spsc_store(&fifo->in, in + size, __ATOMIC_RELEASE);
+
+    return size;
+}
+
+static uint32_t sh_spsc_fifo_peek(sh_spsc_fifo_t *fifo, uint32_t out, 
+                                  void *buf, uint32_t size)
+{
+    uint32_t used_size = fifo->in_cache - out;
+
+    if (size > used_size) {
+        fifo->in_cache = sh_spsc_load(&fifo->in, __ATOMIC_ACQUIRE);
+        used_size = fifo->in_cache - out;
+        if (size > used_size) {
+            size = used_size;
+        }
+    }
+
+    sh_spsc_fifo_copy_out(fifo, out, buf, size);
+
+    return size;
+}
+
+uint32_t sh_spsc_fifo_out_peek(sh_spsc_fifo_t *fifo, void *buf, uint32_t size)
+{
+    SH_ASSERT(fifo);
+    SH_ASSERT(buf);
+
+    uint32_t out = sh_spsc_load(&fifo->out, __ATOMIC_RELAXED);
+
+    return sh_spsc_fifo_peek(fifo, out, buf, size);
+}
+
+uint32_t sh_spsc_fifo_out(sh_spsc_fifo_t *fifo, void *buf, uint32_t size)
+{
+    SH_ASSERT(fifo);
+    SH_ASSERT(buf);
+
+    uint32_t out = sh_spsc_load(&fifo->out, __ATOMIC_RELAXED);
+
+    size = sh_spsc_fifo_peek(fifo, out, buf, size);
+    if (size) {
+        sh_spsc_store(&fifo->out, out + size, __ATOMIC_RELEASE);
+    }
+
+    return size;
+}
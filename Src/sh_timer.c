@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <string.h>
 
 #include "sh_lib.h"
 #include "sh_timer.h"
@@ -14,6 +15,50 @@
 #endif
 
 static sh_timer_get_tick_fn sh_timer_get_tick = NULL;
+static uint32_t sh_timer_saved_wakeups = 0;
+static sh_timer_notify_fn sh_timer_notify = NULL;
+
+#if USE_SH_TIMER_STATS
+static SH_LIST_INIT(sh_timer_stats_head);
+
+static sh_timer_stats_t* sh_timer_stats_find(sh_list_t *head)
+{
+    sh_list_for_each(node, &sh_timer_stats_head) {
+        sh_timer_stats_t *stats = sh_container_of(node, sh_timer_stats_t, list);
+        if (stats->head == head) {
+            return stats;
+        }
+    }
+
+    return NULL;
+}
+
+/* bucket 0 counts zero, bucket n counts [2^(n-1), 2^n) */
+static int sh_timer_stats_bucket(sh_tick_t value)
+{
+    int bucket = 0;
+
+    while (value) {
+        value >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static void sh_timer_stats_record(sh_timer_stats_t *stats, sh_tick_t late, sh_tick_t cb_tick)
+{
+    stats->cnt++;
+
+    stats->late_sum += late;
+    stats->late_max = MAX(stats->late_max, late);
+    stats->late_hist[sh_timer_stats_bucket(late)]++;
+
+    stats->cb_sum += cb_tick;
+    stats->cb_max = MAX(stats->cb_max, cb_tick);
+    stats->cb_hist[sh_timer_stats_bucket(cb_tick)]++;
+}
+#endif
 
 int sh_timer_sys_init(sh_timer_get_tick_fn fn)
 {
@@ -24,6 +69,34 @@ int sh_timer_sys_init(sh_timer_get_tick_fn fn)
     return 0;
 }
 
+sh_tick_t sh_timer_get_current_tick(void)
+{
+    SH_ASSERT(sh_timer_get_tick);
+
+    return sh_timer_get_tick();
+}
+
+/**
+ * fn is called whenever the earliest timer of a list changes, so a driver
+ * can re-arm its hardware or os timer to the new deadline.
+ */
+void sh_timer_set_notify(sh_timer_notify_fn fn)
+{
+    sh_timer_notify = fn;
+}
+
+static void sh_timer_unlink(sh_timer_t *timer)
+{
+    sh_list_t *head = timer->head;
+    bool is_first = ((head != NULL) && (head->next == &timer->list));
+
+    sh_list_remove(&timer->list);
+
+    if (is_first && sh_timer_notify) {
+        sh_timer_notify(head);
+    }
+}
+
 void sh_timer_init(sh_timer_t *timer, enum sh_timer_mode mode, overtick_cb_fn cb)
 {
     SH_ASSERT(timer);
@@ -34,6 +107,9 @@ void sh_timer_init(sh_timer_t *timer, enum sh_timer_mode mode, overtick_cb_fn cb
     timer->enable = false;
     timer->interval_tick = 0;
     timer->overtick = 0;
+    timer->catchup = SH_TIMER_CATCHUP_ALL;
+    timer->slack_tick = 0;
+    timer->head = NULL;
 
     sh_list_init(&timer->list);
 }
@@ -62,7 +138,7 @@ void sh_timer_destroy(sh_timer_t *timer)
 
     int level = sh_isr_disable();
 
-    sh_list_remove(&timer->list);
+    sh_timer_unlink(timer);
     SH_FREE(timer);
 
     sh_isr_enable(level);
@@ -82,10 +158,81 @@ void sh_timer_set_mode(sh_timer_t *timer, enum sh_timer_mode mode)
     timer->mode = mode;
 }
 
+void sh_timer_set_slack(sh_timer_t *timer, sh_tick_t slack_tick)
+{
+    SH_ASSERT(timer);
+
+    timer->slack_tick = slack_tick;
+}
+
+void sh_timer_set_catchup(sh_timer_t *timer, enum sh_timer_catchup catchup)
+{
+    SH_ASSERT(timer);
+
+    timer->catchup = catchup;
+}
+
+static void sh_timer_insert(sh_timer_t *timer, sh_list_t *head)
+{
+    timer->enable = true;
+    timer->head = head;
+
+    sh_list_t *pos = head;
+
+    sh_list_for_each(node, head) {
+        sh_timer_t *_timer = sh_container_of(node, sh_timer_t, list);
+        if ((sh_stick_t)(timer->overtick - _timer->overtick) < 0) {
+            pos = node;
+            break;
+        }
+    }
+    sh_list_insert_before(&timer->list, pos);
+
+    if ((head->next == &timer->list) && sh_timer_notify) {
+        sh_timer_notify(head);
+    }
+}
+
+/**
+ * move the deadline inside [overtick, overtick + slack] so that timers with
+ * close deadlines expire together. an existing deadline in the window is
+ * preferred, otherwise the deadline is rounded to the coarsest tick boundary
+ * in the window, which other timers will round to as well.
+ */
+static sh_tick_t sh_timer_apply_slack(sh_list_t *head, sh_tick_t overtick, 
+                                      sh_tick_t slack_tick)
+{
+    sh_list_for_each(node, head) {
+        sh_timer_t *_timer = sh_container_of(node, sh_timer_t, list);
+        sh_tick_t offset = _timer->overtick - overtick;
+        if ((sh_stick_t)offset < 0) {
+            continue;
+        }
+        if (offset <= slack_tick) {
+            return _timer->overtick;
+        }
+        break;
+    }
+
+    sh_tick_t limit = overtick + slack_tick;
+    sh_tick_t mask = overtick ^ limit;
+    sh_tick_t bit = 1;
+
+    if (mask == 0) {
+        return overtick;
+    }
+
+    while (mask >>= 1) {
+        bit <<= 1;
+    }
+
+    return limit & ~(bit - 1);
+}
+
 int sh_timer_start(sh_timer_t *timer,
                    sh_list_t *head, 
-                   uint32_t now, 
-                   uint32_t interval_tick)
+                   sh_tick_t now, 
+                   sh_tick_t interval_tick)
 {
     SH_ASSERT(timer);
     SH_ASSERT(head);
@@ -93,32 +240,28 @@ int sh_timer_start(sh_timer_t *timer,
 
     int level = sh_isr_disable();
 
-    sh_list_remove(&timer->list);
+    sh_timer_unlink(timer);
 
-    if (interval_tick > (UINT32_MAX / 2)) {
+    if (interval_tick > (SH_TICK_MAX / 2)) {
         sh_isr_enable(level);
         return -1;
     }
 
-    timer->enable = true;
     timer->interval_tick = interval_tick;
     timer->overtick = now + interval_tick;
 
-    sh_list_for_each(node, head) {
-        sh_timer_t *_timer = sh_container_of(node, sh_timer_t, list);
-        if (timer->overtick < _timer->overtick) {
-            sh_list_insert_before(&timer->list, node);
-            sh_isr_enable(level);
-            return 0;
-        }
+    if (timer->slack_tick) {
+        timer->overtick = sh_timer_apply_slack(head, timer->overtick, 
+                                               timer->slack_tick);
     }
-    sh_list_insert_before(&timer->list, head);
+
+    sh_timer_insert(timer, head);
     sh_isr_enable(level);
 
     return 0;
 }
 
-void sh_timer_restart(sh_timer_t *timer, sh_list_t *head, uint32_t now)
+void sh_timer_restart(sh_timer_t *timer, sh_list_t *head, sh_tick_t now)
 {
     SH_ASSERT(timer);
     
@@ -131,44 +274,322 @@ void sh_timer_stop(sh_timer_t *timer)
     
     int level = sh_isr_disable();
     timer->enable = false;
-    sh_list_remove(&timer->list);
+    sh_timer_unlink(timer);
     sh_isr_enable(level);
 }
 
-bool sh_timer_is_time_out(uint32_t now, uint32_t set_tick)
+bool sh_timer_is_time_out(sh_tick_t now, sh_tick_t set_tick)
 {
-    return ((int32_t)(now - set_tick) >= 0);
+    return ((sh_stick_t)(now - set_tick) >= 0);
 }
 
-void sh_timer_handler(sh_list_t *head)
+/**
+ * advance a periodic timer from its previous deadline, so the lateness of
+ * the handler never accumulates. return false if the callback is skipped.
+ * with SH_TIMER_CATCHUP_ALL the deadline moves one period at a time and
+ * the handler fires the timer again while it is still due.
+ */
+static bool sh_timer_periodic_advance(sh_timer_t *timer, sh_tick_t current_tick)
 {
-    if (head == NULL) {
-        return;
+    sh_tick_t late = current_tick - timer->overtick;
+    sh_tick_t missed = 0;
+
+    if (late >= timer->interval_tick) {
+        missed = late / timer->interval_tick;
     }
 
-    SH_ASSERT(sh_timer_get_tick);
+    switch (timer->catchup) {
+    case SH_TIMER_CATCHUP_SKIP:
+        timer->overtick += (missed + 1) * timer->interval_tick;
+        return (missed == 0);
+
+    case SH_TIMER_CATCHUP_ONCE:
+        timer->overtick += (missed + 1) * timer->interval_tick;
+        return true;
+
+    case SH_TIMER_CATCHUP_ALL:
+    default:
+        timer->overtick += timer->interval_tick;
+        return true;
+    }
+}
+
+/**
+ * the timers re-armed by a handler pass mostly come in deadline order, as
+ * timers of the same interval do, so the local list is searched from its
+ * tail. the timer already belongs to head, a callback may stop or restart
+ * it before it is merged.
+ */
+static void sh_timer_insert_rearmed(sh_timer_t *timer, sh_list_t *head, sh_list_t *rearmed)
+{
+    timer->enable = true;
+    timer->head = head;
+
+    sh_list_t *pos = rearmed->prev;
+
+    while (pos != rearmed) {
+        sh_timer_t *_timer = sh_container_of(pos, sh_timer_t, list);
+        if ((sh_stick_t)(timer->overtick - _timer->overtick) >= 0) {
+            break;
+        }
+        pos = pos->prev;
+    }
+    sh_list_insert_after(&timer->list, pos);
+}
+
+/* merge the sorted re-armed timers into head in a single walk */
+static void sh_timer_merge_rearmed(sh_list_t *head, sh_list_t *rearmed)
+{
+    sh_list_t *first = head->next;
+    sh_list_t *pos = head->next;
+
+    while (!sh_list_isempty(rearmed)) {
+        sh_timer_t *timer = sh_container_of(rearmed->next, sh_timer_t, list);
+
+        while (pos != head) {
+            sh_timer_t *_timer = sh_container_of(pos, sh_timer_t, list);
+            if ((sh_stick_t)(timer->overtick - _timer->overtick) < 0) {
+                break;
+            }
+            pos = pos->next;
+        }
+
+        sh_list_remove(&timer->list);
+        sh_list_insert_before(&timer->list, pos);
+    }
+
+    if ((head->next != first) && sh_timer_notify) {
+        sh_timer_notify(head);
+    }
+}
+
+/**
+ * the due timers are detached in one pass, loop and periodic timers are
+ * re-armed into a local sorted list and merged back into head once. with
+ * n timers in head and k due, a pass costs O(n + k) when the k timers
+ * re-arm in deadline order and O(n + k^2) at worst, never O(k * n).
+ * a re-armed timer with slack is aligned with the other re-armed timers
+ * only, looking through head for each of them would cost O(n) again.
+ */
+static void _sh_timer_handler(sh_list_t *head, sh_tick_t current_tick)
+{
+    SH_LIST_INIT(expired);
+    SH_LIST_INIT(rearmed);
+    sh_tick_t last_overtick = 0;
+    bool is_first = true;
 
-    uint32_t current_tick = sh_timer_get_tick();
     int level = sh_isr_disable();
 
-restart:
-    sh_list_for_each(node, head) {
+#if USE_SH_TIMER_STATS
+    sh_timer_stats_t *stats = sh_timer_stats_find(head);
+#endif
+
+    /* the list is sorted, so the due timers are a prefix of it */
+    sh_list_for_each_safe(node, head) {
         sh_timer_t *timer = sh_container_of(node, sh_timer_t, list);
         if (!sh_timer_is_time_out(current_tick, timer->overtick)) {
-            sh_isr_enable(level);
-            return;
+            break;
         }
+        sh_list_remove(node);
+        sh_list_insert_before(node, &expired);
+    }
+
+    /**
+     * a callback may stop, restart or destroy any timer, including the ones
+     * still waiting in the expired list, so always take the first node.
+     */
+    while (!sh_list_isempty(&expired)) {
+        sh_timer_t *timer = sh_container_of(expired.next, sh_timer_t, list);
+
+        bool is_cb_called = true;
+
+        if (timer->slack_tick && !is_first && timer->overtick == last_overtick) {
+            __atomic_fetch_add(&sh_timer_saved_wakeups, 1, __ATOMIC_RELAXED);
+        }
+        last_overtick = timer->overtick;
+        is_first = false;
+
+#if USE_SH_TIMER_STATS
+        sh_tick_t late = current_tick - timer->overtick;
+#endif
+
         sh_timer_stop(timer);
         if (timer->mode == SH_TIMER_MODE_LOOP) {
-            sh_timer_restart(timer, head, current_tick);
+            timer->overtick = current_tick + timer->interval_tick;
+            if (timer->slack_tick) {
+                timer->overtick = sh_timer_apply_slack(&rearmed, timer->overtick, 
+                                                       timer->slack_tick);
+            }
+            sh_timer_insert_rearmed(timer, head, &rearmed);
+        } else if (timer->mode == SH_TIMER_MODE_PERIODIC) {
+            is_cb_called = sh_timer_periodic_advance(timer, current_tick);
+            if (sh_timer_is_time_out(current_tick, timer->overtick)) {
+                /* a missed period of SH_TIMER_CATCHUP_ALL, fired next in this pass */
+                timer->enable = true;
+                timer->head = head;
+                sh_list_insert_after(&timer->list, &expired);
+            } else {
+                sh_timer_insert_rearmed(timer, head, &rearmed);
+            }
+        }
+        if (!timer->cb || !is_cb_called) {
+            continue;
         }
-        if (timer->cb) {
+
+#if USE_SH_TIMER_STATS
+        if (stats) {
+            sh_tick_t start_tick = sh_timer_get_tick();
             timer->cb(timer->param);
-            goto restart;
+            sh_timer_stats_record(stats, late, sh_timer_get_tick() - start_tick);
+            continue;
         }
+#endif
+
+        timer->cb(timer->param);
     }
 
+    sh_timer_merge_rearmed(head, &rearmed);
+
     sh_isr_enable(level);
 }
 
+void sh_timer_handler(sh_list_t *head)
+{
+    if (head == NULL) {
+        return;
+    }
+
+    SH_ASSERT(sh_timer_get_tick);
+
+    _sh_timer_handler(head, sh_timer_get_tick());
+}
+
+/**
+ * get the ticks from now until the earliest timer in the list expires.
+ * ticks_until is 0 if a timer is already due.
+ * return -1 if there is no running timer in the list.
+ */
+int sh_timer_next_expiry(sh_list_t *head, sh_tick_t now, sh_tick_t *ticks_until)
+{
+    SH_ASSERT(head);
+    SH_ASSERT(ticks_until);
+
+    int level = sh_isr_disable();
 
+    if (sh_list_isempty(head)) {
+        sh_isr_enable(level);
+        return -1;
+    }
+
+    sh_timer_t *timer = sh_container_of(head->next, sh_timer_t, list);
+
+    if (sh_timer_is_time_out(now, timer->overtick)) {
+        *ticks_until = 0;
+    } else {
+        *ticks_until = timer->overtick - now;
+    }
+
+    sh_isr_enable(level);
+
+    return 0;
+}
+
+/**
+ * run the due timers, then report how long the caller may sleep before
+ * the next one expires, same return value as sh_timer_next_expiry().
+ */
+int sh_timer_handler_tickless(sh_list_t *head, sh_tick_t *ticks_until)
+{
+    SH_ASSERT(head);
+    SH_ASSERT(ticks_until);
+    SH_ASSERT(sh_timer_get_tick);
+
+    _sh_timer_handler(head, sh_timer_get_tick());
+
+    return sh_timer_next_expiry(head, sh_timer_get_tick(), ticks_until);
+}
+
+/**
+ * the number of timers with slack that expired together with an earlier
+ * timer of the same deadline instead of needing a wakeup of their own.
+ * it is one total for every list of the process, the lists may be run by
+ * different threads, so it is updated atomically.
+ */
+uint32_t sh_timer_get_saved_wakeups(void)
+{
+    return __atomic_load_n(&sh_timer_saved_wakeups, __ATOMIC_RELAXED);
+}
+
+void sh_timer_clear_saved_wakeups(void)
+{
+    __atomic_store_n(&sh_timer_saved_wakeups, 0, __ATOMIC_RELAXED);
+}
+
+#if USE_SH_TIMER_STATS
+/**
+ * record how late the timers of a list fire and how long their callbacks
+ * take, every time sh_timer_handler() runs that list.
+ */
+int sh_timer_stats_attach(sh_timer_stats_t *stats, sh_list_t *head)
+{
+    SH_ASSERT(stats);
+    SH_ASSERT(head);
+
+    int level = sh_isr_disable();
+
+    if (sh_timer_stats_find(head)) {
+        sh_isr_enable(level);
+        return -1;
+    }
+
+    stats->head = head;
+    sh_timer_stats_reset(stats);
+
+    sh_list_init(&stats->list);
+    sh_list_insert_before(&stats->list, &sh_timer_stats_head);
+
+    sh_isr_enable(level);
+
+    return 0;
+}
+
+void sh_timer_stats_detach(sh_timer_stats_t *stats)
+{
+    SH_ASSERT(stats);
+
+    int level = sh_isr_disable();
+    sh_list_remove(&stats->list);
+    sh_isr_enable(level);
+}
+
+void sh_timer_stats_reset(sh_timer_stats_t *stats)
+{
+    SH_ASSERT(stats);
+
+    int level = sh_isr_disable();
+
+    stats->cnt = 0;
+    stats->late_max = 0;
+    stats->late_sum = 0;
+    stats->cb_max = 0;
+    stats->cb_sum = 0;
+    memset(stats->late_hist, 0, sizeof(stats->late_hist));
+    memset(stats->cb_hist, 0, sizeof(stats->cb_hist));
+
+    sh_isr_enable(level);
+}
+
+sh_tick_t sh_timer_stats_get_late_mean(sh_timer_stats_t *stats)
+{
+    SH_ASSERT(stats);
+
+    return stats->cnt ? (sh_tick_t)(stats->late_sum / stats->cnt) : 0;
+}
+
+sh_tick_t sh_timer_stats_get_cb_mean(sh_timer_stats_t *stats)
+{
+    SH_ASSERT(stats);
+
+    return stats->cnt ? (sh_tick_t)(stats->cb_sum / stats->cnt) : 0;
+}
+#endif
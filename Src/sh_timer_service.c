@@ -0,0 +1,370 @@
+#if defined(__linux__)
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "sh_timer_service.h"
+#include "sh_mpmc.h"
+#include "sh_lib.h"
+#include "sh_isr.h"
+#include "sh_assert.h"
+
+#ifndef SH_MALLOC
+    #define SH_MALLOC   malloc
+#endif
+
+#ifndef SH_FREE
+    #define SH_FREE     free
+#endif
+
+enum sh_timer_service_op {
+    SH_TIMER_SERVICE_OP_START = 0,
+    SH_TIMER_SERVICE_OP_RESTART,
+    SH_TIMER_SERVICE_OP_STOP,
+};
+
+typedef struct sh_timer_service_cmd {
+    enum sh_timer_service_op op;
+    sh_timer_t *timer;
+    sh_list_t *head;
+    sh_tick_t interval_tick;
+} sh_timer_service_cmd_t;
+
+/**
+ * the commands pass through a bounded mpmc queue, producers never block
+ * on the thread and the service thread is the only consumer. the list
+ * heads are only ever appended, under head_lock, and head_cnt is stored
+ * after the slot, so the thread and the producers read the slots below
+ * head_cnt without the lock.
+ */
+struct sh_timer_service {
+    sh_mpmc_t *queue;
+
+    pthread_mutex_t head_lock;
+    sh_list_t *timer_head[SH_TIMER_SERVICE_HEAD_MAX];
+    atomic_uint head_cnt;
+    atomic_uint error_cnt;
+
+    uint32_t tick_ns;
+    int event_fd;
+    atomic_bool is_running;
+    pthread_t thread;
+};
+
+static int sh_timer_service_push(sh_timer_service_t *service, 
+                                 const sh_timer_service_cmd_t *cmd)
+{
+    if (sh_mpmc_enqueue(service->queue, cmd)) {
+        return -1;
+    }
+
+    uint64_t value = 1;
+    if (write(service->event_fd, &value, sizeof(value)) < 0) {
+        /* the counter is already non-zero, the thread will wake up anyway */
+    }
+
+    return 0;
+}
+
+/**
+ * called by the producers before a command is queued, so a list the
+ * service cannot run is rejected to the caller.
+ */
+static bool sh_timer_service_has_head(sh_timer_service_t *service, sh_list_t *head)
+{
+    unsigned int head_cnt = atomic_load_explicit(&service->head_cnt, memory_order_acquire);
+
+    for (unsigned int i = 0; i < head_cnt; i++) {
+        if (service->timer_head[i] == head) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * a head that is already registered is found without the lock, so only
+ * the first command for a new head can block its producer.
+ */
+static int sh_timer_service_add_head(sh_timer_service_t *service, sh_list_t *head)
+{
+    int ret = 0;
+
+    if (sh_timer_service_has_head(service, head)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&service->head_lock);
+
+    if (sh_timer_service_has_head(service, head)) {
+        goto unlock;
+    }
+
+    unsigned int head_cnt = atomic_load_explicit(&service->head_cnt, memory_order_relaxed);
+    if (head_cnt >= SH_TIMER_SERVICE_HEAD_MAX) {
+        ret = -1;
+        goto unlock;
+    }
+
+    service->timer_head[head_cnt] = head;
+    atomic_store_explicit(&service->head_cnt, head_cnt + 1, memory_order_release);
+
+unlock:
+    pthread_mutex_unlock(&service->head_lock);
+
+    return ret;
+}
+
+static void sh_timer_service_execute(sh_timer_service_t *service, 
+                                     const sh_timer_service_cmd_t *cmd)
+{
+    sh_tick_t interval_tick = 0;
+
+    switch (cmd->op) {
+    case SH_TIMER_SERVICE_OP_START:
+        interval_tick = cmd->interval_tick;
+        break;
+
+    case SH_TIMER_SERVICE_OP_RESTART:
+        /* a timer that was never started has no interval to restart with */
+        interval_tick = cmd->timer->interval_tick;
+        break;
+
+    case SH_TIMER_SERVICE_OP_STOP:
+        sh_timer_stop(cmd->timer);
+        return;
+
+    default:
+        return;
+    }
+
+    if ((interval_tick == 0) ||
+        sh_timer_start(cmd->timer, cmd->head, sh_timer_get_current_tick(), interval_tick)) {
+        atomic_fetch_add(&service->error_cnt, 1);
+    }
+}
+
+static void sh_timer_service_wait(sh_timer_service_t *service, 
+                                  bool is_forever, sh_tick_t ticks_until)
+{
+    struct pollfd pfd = {
+        .fd = service->event_fd,
+        .events = POLLIN,
+    };
+    struct timespec timeout;
+    uint64_t ns = (uint64_t)ticks_until * service->tick_ns;
+    uint64_t value = 0;
+
+    timeout.tv_sec = ns / 1000000000ull;
+    timeout.tv_nsec = ns % 1000000000ull;
+
+    if (ppoll(&pfd, 1, is_forever ? NULL : &timeout, NULL) > 0) {
+        if (read(service->event_fd, &value, sizeof(value)) < 0) {
+            /* nothing to drain */
+        }
+    }
+}
+
+static void* sh_timer_service_thread(void *arg)
+{
+    sh_timer_service_t *service = (sh_timer_service_t*)arg;
+    sh_timer_service_cmd_t cmd;
+
+    while (atomic_load(&service->is_running)) {
+        bool is_forever = true;
+        sh_tick_t ticks_until = 0;
+
+        while (sh_mpmc_dequeue(service->queue, &cmd) == 0) {
+            sh_timer_service_execute(service, &cmd);
+        }
+
+        unsigned int head_cnt = atomic_load(&service->head_cnt);
+        for (unsigned int i = 0; i < head_cnt; i++) {
+            sh_tick_t _ticks_until = 0;
+            if (sh_timer_handler_tickless(service->timer_head[i], &_ticks_until)) {
+                continue;
+            }
+            if (is_forever || (_ticks_until < ticks_until)) {
+                ticks_until = _ticks_until;
+                is_forever = false;
+            }
+        }
+
+        sh_timer_service_wait(service, is_forever, ticks_until);
+    }
+
+    return NULL;
+}
+
+/**
+ * start a thread that owns every timer list used through the service.
+ * cmd_cnt is rounded up to a power of two, tick_ns is the length of one
+ * sh_timer tick. the timer callbacks run on the service thread, use
+ * sh_timer_service_post_cb() to hand them to an event server instead.
+ */
+sh_timer_service_t* sh_timer_service_create(uint32_t cmd_cnt, uint32_t tick_ns)
+{
+    SH_ASSERT(cmd_cnt);
+    SH_ASSERT(tick_ns);
+
+    int level = sh_isr_disable();
+    sh_timer_service_t *service = SH_MALLOC(sizeof(sh_timer_service_t));
+    if (service) {
+        service->queue = sh_mpmc_create(cmd_cnt, sizeof(sh_timer_service_cmd_t));
+    }
+    sh_isr_enable(level);
+    if (service == NULL) {
+        return NULL;
+    }
+    if (service->queue == NULL) {
+        goto free_service;
+    }
+
+    pthread_mutex_init(&service->head_lock, NULL);
+    atomic_init(&service->head_cnt, 0);
+    atomic_init(&service->error_cnt, 0);
+    service->tick_ns = tick_ns;
+    atomic_init(&service->is_running, true);
+
+    service->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (service->event_fd < 0) {
+        goto destroy_queue;
+    }
+
+    if (pthread_create(&service->thread, NULL, sh_timer_service_thread, service)) {
+        goto close_fd;
+    }
+
+    return service;
+
+close_fd:
+    close(service->event_fd);
+destroy_queue:
+    pthread_mutex_destroy(&service->head_lock);
+    level = sh_isr_disable();
+    sh_mpmc_destroy(service->queue);
+    sh_isr_enable(level);
+free_service:
+    level = sh_isr_disable();
+    SH_FREE(service);
+    sh_isr_enable(level);
+
+    return NULL;
+}
+
+void sh_timer_service_destroy(sh_timer_service_t *service)
+{
+    if (service == NULL) {
+        return;
+    }
+
+    uint64_t value = 1;
+
+    atomic_store(&service->is_running, false);
+    if (write(service->event_fd, &value, sizeof(value)) < 0) {
+        /* the thread is already awake */
+    }
+    pthread_join(service->thread, NULL);
+
+    close(service->event_fd);
+    pthread_mutex_destroy(&service->head_lock);
+
+    int level = sh_isr_disable();
+    sh_mpmc_destroy(service->queue);
+    SH_FREE(service);
+    sh_isr_enable(level);
+}
+
+int sh_timer_service_start_timer(sh_timer_service_t *service, sh_timer_t *timer, 
+                                 sh_list_t *head, sh_tick_t interval_tick)
+{
+    SH_ASSERT(service);
+    SH_ASSERT(timer);
+    SH_ASSERT(head);
+
+    if ((interval_tick == 0) || (interval_tick > (SH_TICK_MAX / 2)) ||
+        sh_timer_service_add_head(service, head)) {
+        return -1;
+    }
+
+    sh_timer_service_cmd_t cmd = {
+        .op = SH_TIMER_SERVICE_OP_START,
+        .timer = timer,
+        .head = head,
+        .interval_tick = interval_tick,
+    };
+
+    return sh_timer_service_push(service, &cmd);
+}
+
+int sh_timer_service_restart_timer(sh_timer_service_t *service, sh_timer_t *timer, 
+                                   sh_list_t *head)
+{
+    SH_ASSERT(service);
+    SH_ASSERT(timer);
+    SH_ASSERT(head);
+
+    if (sh_timer_service_add_head(service, head)) {
+        return -1;
+    }
+
+    sh_timer_service_cmd_t cmd = {
+        .op = SH_TIMER_SERVICE_OP_RESTART,
+        .timer = timer,
+        .head = head,
+    };
+
+    return sh_timer_service_push(service, &cmd);
+}
+
+int sh_timer_service_stop_timer(sh_timer_service_t *service, sh_timer_t *timer)
+{
+    SH_ASSERT(service);
+    SH_ASSERT(timer);
+
+    sh_timer_service_cmd_t cmd = {
+        .op = SH_TIMER_SERVICE_OP_STOP,
+        .timer = timer,
+    };
+
+    return sh_timer_service_push(service, &cmd);
+}
+
+/**
+ * the number of queued start and restart commands the service thread
+ * could not apply, a restart of a timer that never ran for example.
+ */
+uint32_t sh_timer_service_get_error_count(sh_timer_service_t *service)
+{
+    SH_ASSERT(service);
+
+    return atomic_load(&service->error_cnt);
+}
+
+/**
+ * timer callback that posts the event of a sh_timer_service_event_t to its
+ * server, the server then handles it on its own thread. register a sh_isr
+ * backed by a recursive mutex when servers are shared between threads.
+ */
+void sh_timer_service_post_cb(void *param)
+{
+    SH_ASSERT(param);
+
+    sh_timer_service_event_t *event = (sh_timer_service_event_t*)param;
+
+    sh_event_post(event->server, event->event_id, NULL, 0);
+}
+
+#endif
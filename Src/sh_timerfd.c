@@ -0,0 +1,144 @@
+#if defined(__linux__)
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "sh_timerfd.h"
+#include "sh_lib.h"
+#include "sh_assert.h"
+#include "sh_isr.h"
+
+static SH_LIST_INIT(sh_timerfd_head);
+
+static int sh_timerfd_set(sh_timerfd_t *tfd, bool is_enable, sh_tick_t ticks_until)
+{
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+
+    if (is_enable) {
+        uint64_t ns = (uint64_t)ticks_until * tfd->tick_ns;
+
+        /* a zero it_value would disarm the timerfd, fire as soon as possible */
+        if (ns == 0) {
+            ns = 1;
+        }
+
+        spec.it_value.tv_sec = ns / 1000000000ull;
+        spec.it_value.tv_nsec = ns % 1000000000ull;
+    }
+
+    return timerfd_settime(tfd->fd, 0, &spec, NULL);
+}
+
+static void sh_timerfd_notify(sh_list_t *head)
+{
+    sh_list_for_each(node, &sh_timerfd_head) {
+        sh_timerfd_t *tfd = sh_container_of(node, sh_timerfd_t, list);
+        if ((tfd->head == head) && !tfd->is_dispatching) {
+            sh_timerfd_arm(tfd);
+        }
+    }
+}
+
+/**
+ * bind a timer list to a timerfd, the fd becomes readable when the earliest
+ * timer of the list is due. tick_ns is the length of one sh_timer tick.
+ */
+int sh_timerfd_init(sh_timerfd_t *tfd, sh_list_t *head, uint32_t tick_ns)
+{
+    SH_ASSERT(tfd);
+    SH_ASSERT(head);
+    SH_ASSERT(tick_ns);
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    tfd->fd = fd;
+    tfd->head = head;
+    tfd->tick_ns = tick_ns;
+    tfd->is_dispatching = false;
+
+    int level = sh_isr_disable();
+
+    sh_list_init(&tfd->list);
+    sh_list_insert_before(&tfd->list, &sh_timerfd_head);
+    sh_timer_set_notify(sh_timerfd_notify);
+
+    sh_isr_enable(level);
+
+    return sh_timerfd_arm(tfd);
+}
+
+void sh_timerfd_deinit(sh_timerfd_t *tfd)
+{
+    if (tfd == NULL) {
+        return;
+    }
+
+    int level = sh_isr_disable();
+
+    sh_list_remove(&tfd->list);
+    if (sh_list_isempty(&sh_timerfd_head)) {
+        sh_timer_set_notify(NULL);
+    }
+
+    sh_isr_enable(level);
+
+    close(tfd->fd);
+    tfd->fd = -1;
+}
+
+int sh_timerfd_get_fd(sh_timerfd_t *tfd)
+{
+    SH_ASSERT(tfd);
+
+    return tfd->fd;
+}
+
+/**
+ * re-arm the timerfd to the earliest deadline of the list, or disarm it if
+ * the list is empty. called automatically when the head of the list changes.
+ */
+int sh_timerfd_arm(sh_timerfd_t *tfd)
+{
+    SH_ASSERT(tfd);
+
+    sh_tick_t ticks_until = 0;
+    sh_tick_t now = sh_timer_get_current_tick();
+
+    if (sh_timer_next_expiry(tfd->head, now, &ticks_until)) {
+        return sh_timerfd_set(tfd, false, 0);
+    }
+
+    return sh_timerfd_set(tfd, true, ticks_until);
+}
+
+/**
+ * call when the fd is readable, runs the due timers and re-arms the fd.
+ */
+int sh_timerfd_dispatch(sh_timerfd_t *tfd)
+{
+    SH_ASSERT(tfd);
+
+    uint64_t expirations = 0;
+    sh_tick_t ticks_until = 0;
+
+    if (read(tfd->fd, &expirations, sizeof(expirations)) < 0) {
+        if (errno != EAGAIN) {
+            return -1;
+        }
+    }
+
+    tfd->is_dispatching = true;
+    int ret = sh_timer_handler_tickless(tfd->head, &ticks_until);
+    tfd->is_dispatching = false;
+
+    return sh_timerfd_set(tfd, (ret == 0), ticks_until);
+}
+
+#endif
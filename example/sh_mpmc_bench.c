@@ -0,0 +1,135 @@
+/**
+ * throughput of sh_mpmc against sh_fifo behind the global isr lock.
+ * every thread enqueues one element and dequeues one, the queue never
+ * runs empty or full, so only the synchronization is measured.
+ *
+ * gcc -O2 -std=gnu11 -IInc example/sh_mpmc_bench.c Src/sh_mpmc.c Src/sh_fifo.c \
+ *     Src/sh_mem.c Src/sh_isr.c Src/tlsf.c -lpthread
+ */
+#if defined(__linux__)
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "sh_mpmc.h"
+#include "sh_fifo.h"
+#include "sh_isr.h"
+
+#define BENCH_THREAD_MAX    16
+#define BENCH_OPS           200000
+#define BENCH_QUEUE_SIZE    256
+
+static pthread_mutex_t bench_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t bench_barrier;
+static sh_mpmc_t *bench_mpmc;
+static sh_fifo_t *bench_fifo;
+
+static int bench_isr_disable(void)
+{
+    pthread_mutex_lock(&bench_mutex);
+    return 0;
+}
+
+static void bench_isr_enable(int level)
+{
+    (void)level;
+    pthread_mutex_unlock(&bench_mutex);
+}
+
+static void* bench_mpmc_thread(void *arg)
+{
+    uint32_t elem = 0;
+
+    (void)arg;
+    pthread_barrier_wait(&bench_barrier);
+
+    for (int i = 0; i < BENCH_OPS; i++) {
+        while (sh_mpmc_enqueue(bench_mpmc, &elem)) {
+        }
+        while (sh_mpmc_dequeue(bench_mpmc, &elem)) {
+        }
+    }
+
+    return NULL;
+}
+
+static void* bench_fifo_thread(void *arg)
+{
+    uint32_t elem = 0;
+
+    (void)arg;
+    pthread_barrier_wait(&bench_barrier);
+
+    for (int i = 0; i < BENCH_OPS; i++) {
+        while (sh_fifo_in(bench_fifo, &elem, 1) == 0) {
+        }
+        while (sh_fifo_out(bench_fifo, &elem, 1) == 0) {
+        }
+    }
+
+    return NULL;
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* return million operations per second, an enqueue and a dequeue are two */
+static double bench_run(void *(*fn)(void*), int thread_cnt)
+{
+    pthread_t thread[BENCH_THREAD_MAX];
+
+    pthread_barrier_init(&bench_barrier, NULL, thread_cnt + 1);
+
+    for (int i = 0; i < thread_cnt; i++) {
+        pthread_create(&thread[i], NULL, fn, NULL);
+    }
+
+    pthread_barrier_wait(&bench_barrier);
+    double start = bench_now();
+
+    for (int i = 0; i < thread_cnt; i++) {
+        pthread_join(thread[i], NULL);
+    }
+
+    double elapsed = bench_now() - start;
+
+    pthread_barrier_destroy(&bench_barrier);
+
+    return 2.0 * BENCH_OPS * thread_cnt / elapsed / 1e6;
+}
+
+int main(void)
+{
+    sh_isr_t isr = {bench_isr_disable, bench_isr_enable};
+    sh_isr_register(&isr);
+
+    bench_mpmc = sh_mpmc_create(BENCH_QUEUE_SIZE, sizeof(uint32_t));
+    bench_fifo = sh_fifo_create(BENCH_QUEUE_SIZE, sizeof(uint32_t));
+    if ((bench_mpmc == NULL) || (bench_fifo == NULL)) {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    printf("threads   sh_mpmc Mops/s   sh_fifo Mops/s\n");
+
+    for (int thread_cnt = 1; thread_cnt <= BENCH_THREAD_MAX; thread_cnt <<= 1) {
+        double mpmc = bench_run(bench_mpmc_thread, thread_cnt);
+        double fifo = bench_run(bench_fifo_thread, thread_cnt);
+
+        printf("%7d   %14.2f   %14.2f\n", thread_cnt, mpmc, fifo);
+    }
+
+    sh_mpmc_destroy(bench_mpmc);
+    sh_fifo_destroy(bench_fifo);
+
+    return 0;
+}
+
+#endif
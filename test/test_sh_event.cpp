@@ -244,3 +244,40 @@ TEST_F(TEST_SH_EVENT, server_name_max_len_test) {
     sh_event_server_destroy(server);
 }
 
+
+static volatile int table_cnt;
+
+static void test_table_cb(const sh_event_msg_t *e)
+{
+    (void)e;
+    table_cnt++;
+}
+
+TEST_F(TEST_SH_EVENT, cb_table_test) {
+    event_cb table[] = {test_table_cb, test_table_cb, test_table_cb};
+
+    table_cnt = 0;
+
+    ASSERT_EQ(0, sh_event_subscribe(server1, SH_EVENT_INIT, test_event_cb));
+    ASSERT_EQ(0, sh_event_subscribe_sync(server1, SH_EVENT_ENTER, test_event_cb));
+
+    sh_event_server_set_cb_table(server1, table);
+
+    ASSERT_EQ(0, sh_event_publish(map, SH_EVENT_INIT));
+    ASSERT_EQ(0, sh_event_publish(map, SH_EVENT_ENTER));
+    ASSERT_EQ(0, sh_event_publish(map, SH_EVENT_EXIT));
+    ASSERT_EQ(0, sh_event_handler(server1));
+    EXPECT_EQ(2, table_cnt);
+    EXPECT_EQ(0, init_cnt);
+    EXPECT_EQ(0, enter_cnt);
+
+    sh_event_server_set_cb_table(server1, NULL);
+
+    ASSERT_EQ(0, sh_event_publish(map, SH_EVENT_INIT));
+    ASSERT_EQ(0, sh_event_handler(server1));
+    EXPECT_EQ(2, table_cnt);
+    EXPECT_EQ(1, init_cnt);
+
+    ASSERT_EQ(0, sh_event_unsubscribe(server1, SH_EVENT_INIT));
+    ASSERT_EQ(0, sh_event_unsubscribe(server1, SH_EVENT_ENTER));
+}
@@ -137,3 +137,114 @@ TEST_F(TEST_SH_FIFO, fifo_in_out_for_multi_esize_test) {
 }
 
 
+
+TEST_F(TEST_SH_FIFO, fifo_prepare_commit_test)
+{
+    void *ptr = NULL;
+    uint32_t len = 0;
+
+    EXPECT_EQ(0, sh_fifo_in_prepare(fifo, &ptr, &len));
+    EXPECT_EQ(fifo->data, ptr);
+    EXPECT_EQ(9, len);
+
+    memcpy(ptr, buf_in, 7);
+    EXPECT_EQ(-1, sh_fifo_in_commit(fifo, 10));
+    EXPECT_EQ(0, sh_fifo_in_commit(fifo, 7));
+    FIFO_USED_SIZE_TEST(7);
+
+    EXPECT_EQ(5, sh_fifo_out(fifo, buf_out, 5));
+
+    /* the region ends at the end of the buffer */
+    EXPECT_EQ(0, sh_fifo_in_prepare(fifo, &ptr, &len));
+    EXPECT_EQ((uint8_t *)fifo->data + 7, ptr);
+    EXPECT_EQ(3, len);
+    memcpy(ptr, buf_in, 3);
+    EXPECT_EQ(0, sh_fifo_in_commit(fifo, 3));
+
+    EXPECT_EQ(0, sh_fifo_in_prepare(fifo, &ptr, &len));
+    EXPECT_EQ(fifo->data, ptr);
+    EXPECT_EQ(4, len);
+    memcpy(ptr, buf_in + 3, 4);
+    EXPECT_EQ(0, sh_fifo_in_commit(fifo, 4));
+    FIFO_USED_SIZE_TEST(9);
+
+    EXPECT_EQ(0, sh_fifo_in_prepare(fifo, &ptr, &len));
+    EXPECT_EQ(0, len);
+
+    EXPECT_EQ(9, sh_fifo_out(fifo, buf_out, 9));
+    uint8_t expect[] = {0x06, 0x07, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07};
+    EXPECT_EQ(0, memcmp(expect, buf_out, sizeof(expect)));
+}
+
+TEST_F(TEST_SH_FIFO, fifo_peek_linear_consume_test)
+{
+    void *ptr = NULL;
+    uint32_t len = 0;
+
+    EXPECT_EQ(0, sh_fifo_out_peek_linear(fifo, &ptr, &len));
+    EXPECT_EQ(0, len);
+    EXPECT_EQ(-1, sh_fifo_out_consume(fifo, 1));
+
+    EXPECT_EQ(8, sh_fifo_in(fifo, buf_in, 8));
+    EXPECT_EQ(6, sh_fifo_out(fifo, buf_out, 6));
+    EXPECT_EQ(6, sh_fifo_in(fifo, buf_in, 6));
+    FIFO_USED_SIZE_TEST(8);
+
+    /* the data wraps, the first region stops at the end of the buffer */
+    EXPECT_EQ(0, sh_fifo_out_peek_linear(fifo, &ptr, &len));
+    EXPECT_EQ((uint8_t *)fifo->data + 6, ptr);
+    EXPECT_EQ(4, len);
+    EXPECT_EQ(0x07, ((uint8_t *)ptr)[0]);
+    EXPECT_EQ(0x01, ((uint8_t *)ptr)[2]);
+
+    EXPECT_EQ(-1, sh_fifo_out_consume(fifo, 9));
+    EXPECT_EQ(0, sh_fifo_out_consume(fifo, 4));
+    FIFO_USED_SIZE_TEST(4);
+
+    EXPECT_EQ(0, sh_fifo_out_peek_linear(fifo, &ptr, &len));
+    EXPECT_EQ(fifo->data, ptr);
+    EXPECT_EQ(4, len);
+    EXPECT_EQ(0x03, ((uint8_t *)ptr)[0]);
+    EXPECT_EQ(0, sh_fifo_out_consume(fifo, 4));
+    FIFO_USED_SIZE_TEST(0);
+}
+
+#if defined(__linux__)
+#include <unistd.h>
+
+TEST_F(TEST_SH_FIFO, fifo_mirrored_test)
+{
+    void *ptr = NULL;
+    uint32_t len = 0;
+
+    EXPECT_FALSE(sh_fifo_create_mirrored(0, 1));
+
+    sh_fifo_t *_fifo = sh_fifo_create_mirrored(10, 3);
+    ASSERT_TRUE(_fifo);
+    EXPECT_TRUE(_fifo->is_mirrored);
+    EXPECT_LE(10, _fifo->size);
+    EXPECT_EQ(0, (_fifo->size * 3) % sysconf(_SC_PAGESIZE));
+
+    /* start just before the wrap point */
+    _fifo->in = _fifo->out = _fifo->size - 1;
+
+    EXPECT_EQ(3, sh_fifo_in(_fifo, buf_in, 3));
+    EXPECT_EQ(0, memcmp((uint8_t *)_fifo->data + 3 * (_fifo->size - 1), buf_in, 9));
+    EXPECT_EQ(0, memcmp(_fifo->data, buf_in + 3, 6));
+    EXPECT_EQ(2, _fifo->in);
+
+    /* the whole content is one region */
+    EXPECT_EQ(0, sh_fifo_out_peek_linear(_fifo, &ptr, &len));
+    EXPECT_EQ(3, len);
+    EXPECT_EQ(0, memcmp(ptr, buf_in, 9));
+
+    EXPECT_EQ(0, sh_fifo_in_prepare(_fifo, &ptr, &len));
+    EXPECT_EQ(_fifo->size - 4, len);
+
+    EXPECT_EQ(3, sh_fifo_out(_fifo, buf_out, 3));
+    EXPECT_EQ(0, memcmp(buf_out, buf_in, 9));
+    EXPECT_EQ(0, sh_fifo_get_used_size(_fifo));
+
+    sh_fifo_destroy(_fifo);
+}
+#endif
@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include "sh_kfifo.h"
+
+using namespace testing;
+
+#define KFIFO_SIZE  8
+
+#define KFIFO_USED_SIZE_TEST(used) \
+            EXPECT_EQ(sh_kfifo_get_unused_size(fifo), (KFIFO_SIZE) - (used)); \
+            EXPECT_EQ(sh_kfifo_get_used_size(fifo), (used));
+
+class TEST_SH_KFIFO : public testing::Test {
+protected:  
+    void SetUp()
+    {
+        mem_size = sh_get_free_size();
+
+        fifo = sh_kfifo_create(KFIFO_SIZE, 1);
+        ASSERT_TRUE(fifo);
+
+        KFIFO_USED_SIZE_TEST(0);
+    }
+
+    void TearDown()
+    {
+        sh_kfifo_destroy(fifo);
+
+        EXPECT_EQ(mem_size, sh_get_free_size());
+    }
+
+    sh_kfifo_t *fifo = NULL;
+    uint32_t mem_size;
+    uint8_t buf_in[10] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A};
+    uint8_t buf_out[10] = {0};
+};
+
+TEST_F(TEST_SH_KFIFO, kfifo_create_test) {
+    uint8_t data[12];
+    sh_kfifo_t _fifo;
+
+    EXPECT_FALSE(sh_kfifo_create(0, 1));
+    EXPECT_FALSE(sh_kfifo_create(12, 1));
+    EXPECT_EQ(-1, sh_kfifo_init(&_fifo, data, 12, 1));
+    EXPECT_EQ(-1, sh_kfifo_init(&_fifo, data, 4, 0));
+    EXPECT_EQ(0, sh_kfifo_init(&_fifo, data, 4, 3));
+}
+
+TEST_F(TEST_SH_KFIFO, kfifo_full_capacity_test) {
+    EXPECT_EQ(KFIFO_SIZE, sh_kfifo_in(fifo, buf_in, 10));
+    KFIFO_USED_SIZE_TEST(KFIFO_SIZE);
+    EXPECT_EQ(0, sh_kfifo_in(fifo, buf_in, 1));
+
+    EXPECT_EQ(KFIFO_SIZE, sh_kfifo_out_peek(fifo, buf_out, 10));
+    KFIFO_USED_SIZE_TEST(KFIFO_SIZE);
+
+    EXPECT_EQ(KFIFO_SIZE, sh_kfifo_out(fifo, buf_out, 10));
+    KFIFO_USED_SIZE_TEST(0);
+    for (int i = 0; i < KFIFO_SIZE; i++) {
+        EXPECT_EQ(buf_out[i], i + 1);
+    }
+    EXPECT_EQ(0, sh_kfifo_out(fifo, buf_out, 1));
+}
+
+TEST_F(TEST_SH_KFIFO, kfifo_in_out_wrap_test) {
+    EXPECT_EQ(6, sh_kfifo_in(fifo, buf_in, 6));
+    EXPECT_EQ(5, sh_kfifo_out(fifo, buf_out, 5));
+    KFIFO_USED_SIZE_TEST(1);
+
+    EXPECT_EQ(7, sh_kfifo_in(fifo, buf_in, 7));
+    KFIFO_USED_SIZE_TEST(8);
+
+    EXPECT_EQ(8, sh_kfifo_out(fifo, buf_out, 8));
+    EXPECT_EQ(buf_out[0], 6);
+    for (int i = 1; i < 8; i++) {
+        EXPECT_EQ(buf_out[i], i);
+    }
+}
+
+TEST_F(TEST_SH_KFIFO, kfifo_counter_overflow_test) {
+    /* the counters run freely through the 32 bit wrap */
+    fifo->in = fifo->out = UINT32_MAX - 2;
+
+    EXPECT_EQ(5, sh_kfifo_in(fifo, buf_in, 5));
+    KFIFO_USED_SIZE_TEST(5);
+    EXPECT_EQ(3, sh_kfifo_in(fifo, buf_in + 5, 5));
+    KFIFO_USED_SIZE_TEST(8);
+
+    EXPECT_EQ(8, sh_kfifo_out(fifo, buf_out, 8));
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(buf_out[i], i + 1);
+    }
+    KFIFO_USED_SIZE_TEST(0);
+}
+
+TEST_F(TEST_SH_KFIFO, kfifo_multi_esize_test) {
+    uint8_t expect[] = {0x05, 0x06, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A};
+    sh_kfifo_t *_fifo = sh_kfifo_create(4, 2);
+    ASSERT_TRUE(_fifo);
+
+    EXPECT_EQ(3, sh_kfifo_in(_fifo, buf_in, 3));
+    EXPECT_EQ(2, sh_kfifo_out(_fifo, buf_out, 2));
+    EXPECT_EQ(buf_out[0], 0x01);
+    EXPECT_EQ(buf_out[3], 0x04);
+
+    EXPECT_EQ(3, sh_kfifo_in(_fifo, buf_in + 4, 3));
+    EXPECT_EQ(4, sh_kfifo_out(_fifo, buf_out, 4));
+    EXPECT_EQ(0, memcmp(expect, buf_out, sizeof(expect)));
+
+    sh_kfifo_destroy(_fifo);
+}
@@ -0,0 +1,143 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "sh_mpmc.h"
+
+using namespace testing;
+
+class TEST_SH_MPMC : public testing::Test {
+protected:  
+    void SetUp()
+    {
+        mem_size = sh_get_free_size();
+
+        mpmc = sh_mpmc_create(6, 2);
+        ASSERT_TRUE(mpmc);
+    }
+
+    void TearDown()
+    {
+        sh_mpmc_destroy(mpmc);
+
+        EXPECT_EQ(mem_size, sh_get_free_size());
+    }
+
+    sh_mpmc_t *mpmc = NULL;
+    uint32_t mem_size;
+    uint16_t buf_in[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    uint16_t buf_out[10] = {0};
+};
+
+TEST_F(TEST_SH_MPMC, mpmc_create_test) {
+    EXPECT_FALSE(sh_mpmc_create(0, 1));
+    EXPECT_FALSE(sh_mpmc_create(8, 0));
+    EXPECT_EQ(8, sh_mpmc_get_size(mpmc));
+    EXPECT_EQ(0, sh_mpmc_get_used_size(mpmc));
+}
+
+TEST_F(TEST_SH_MPMC, mpmc_enqueue_dequeue_test) {
+    uint16_t elem = 0;
+
+    EXPECT_EQ(-1, sh_mpmc_dequeue(mpmc, &elem));
+
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(0, sh_mpmc_enqueue(mpmc, &buf_in[i]));
+    }
+    EXPECT_EQ(-1, sh_mpmc_enqueue(mpmc, &buf_in[8]));
+    EXPECT_EQ(8, sh_mpmc_get_used_size(mpmc));
+
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(0, sh_mpmc_dequeue(mpmc, &elem));
+        EXPECT_EQ(i + 1, elem);
+    }
+    EXPECT_EQ(-1, sh_mpmc_dequeue(mpmc, &elem));
+}
+
+TEST_F(TEST_SH_MPMC, mpmc_batch_test) {
+    EXPECT_EQ(0, sh_mpmc_enqueue_batch(mpmc, buf_in, 0));
+    EXPECT_EQ(5, sh_mpmc_enqueue_batch(mpmc, buf_in, 5));
+    EXPECT_EQ(3, sh_mpmc_dequeue_batch(mpmc, buf_out, 3));
+
+    /* the batch stops at the first full slot and wraps around */
+    EXPECT_EQ(6, sh_mpmc_enqueue_batch(mpmc, buf_in + 4, 6));
+    EXPECT_EQ(8, sh_mpmc_get_used_size(mpmc));
+    EXPECT_EQ(0, sh_mpmc_enqueue_batch(mpmc, buf_in, 1));
+
+    EXPECT_EQ(8, sh_mpmc_dequeue_batch(mpmc, buf_out, 10));
+    uint16_t expect[] = {4, 5, 5, 6, 7, 8, 9, 10};
+    EXPECT_EQ(0, memcmp(expect, buf_out, sizeof(expect)));
+    EXPECT_EQ(0, sh_mpmc_dequeue_batch(mpmc, buf_out, 10));
+}
+
+#define MPMC_THREAD_CNT     4
+#define MPMC_ELEM_CNT       20000
+
+TEST(TEST_SH_MPMC_THREAD, mpmc_stress_test) {
+    sh_mpmc_t *mpmc = sh_mpmc_create(64, sizeof(uint32_t));
+    ASSERT_TRUE(mpmc);
+
+    std::atomic<uint32_t> consumed(0);
+    std::atomic<uint64_t> sum(0);
+    std::atomic<bool> in_order(true);
+    std::vector<std::thread> threads;
+
+    for (uint32_t p = 0; p < MPMC_THREAD_CNT; p++) {
+        threads.emplace_back([mpmc, p]() {
+            for (uint32_t i = 0; i < MPMC_ELEM_CNT; ) {
+                uint32_t buf[3];
+                uint32_t n = 0;
+                for (; (n < 3) && (i + n < MPMC_ELEM_CNT); n++) {
+                    buf[n] = (p << 24) | (i + n);
+                }
+                uint32_t cnt = sh_mpmc_enqueue_batch(mpmc, buf, n);
+                if (cnt == 0) {
+                    std::this_thread::yield();
+                }
+                i += cnt;
+            }
+        });
+    }
+
+    for (uint32_t c = 0; c < MPMC_THREAD_CNT; c++) {
+        threads.emplace_back([&]() {
+            /* every producer's values reach a consumer in order */
+            int32_t last[MPMC_THREAD_CNT];
+            for (int i = 0; i < MPMC_THREAD_CNT; i++) {
+                last[i] = -1;
+            }
+
+            while (consumed.load() < MPMC_THREAD_CNT * MPMC_ELEM_CNT) {
+                uint32_t buf[4];
+                uint32_t n = sh_mpmc_dequeue_batch(mpmc, buf, 4);
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+                for (uint32_t i = 0; i < n; i++) {
+                    uint32_t p = buf[i] >> 24;
+                    int32_t value = buf[i] & 0xFFFFFF;
+                    if (value <= last[p]) {
+                        in_order = false;
+                    }
+                    last[p] = value;
+                    sum += value;
+                }
+                consumed += n;
+            }
+        });
+    }
+
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    EXPECT_TRUE(in_order);
+    EXPECT_EQ(MPMC_THREAD_CNT * MPMC_ELEM_CNT, consumed.load());
+    EXPECT_EQ((uint64_t)MPMC_THREAD_CNT * MPMC_ELEM_CNT * (MPMC_ELEM_CNT - 1) / 2, sum.load());
+    EXPECT_EQ(0, sh_mpmc_get_used_size(mpmc));
+
+    sh_mpmc_destroy(mpmc);
+}
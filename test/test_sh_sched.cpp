@@ -0,0 +1,192 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sh_sched.h"
+#include "sh_isr.h"
+#include "sh_lib.h"
+
+using namespace testing;
+
+#define SCHED_SM_CNT    4
+
+enum {
+    SCHED_EVENT_PING = 0,
+    SCHED_EVENT_TIMEOUT,
+    SCHED_EVENT_MAX,
+};
+
+static std::atomic<int> sched_event_cnt[SCHED_EVENT_MAX];
+static pthread_mutex_t sched_mutex;
+
+static int sched_isr_disable(void)
+{
+    pthread_mutex_lock(&sched_mutex);
+    return 0;
+}
+
+static void sched_isr_enable(int level)
+{
+    (void)level;
+    pthread_mutex_unlock(&sched_mutex);
+}
+
+static sh_tick_t sched_get_tick_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (sh_tick_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void sched_event_cb(const sh_event_msg_t *e)
+{
+    sched_event_cnt[e->id]++;
+}
+
+class TEST_SH_SCHED : public testing::Test {
+protected:
+    void SetUp()
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&sched_mutex, &attr);
+
+        sh_isr_t isr = {sched_isr_disable, sched_isr_enable};
+        ASSERT_EQ(0, sh_isr_register(&isr));
+
+        for (int i = 0; i < SCHED_EVENT_MAX; i++) {
+            sched_event_cnt[i] = 0;
+        }
+
+        free_size = sh_get_free_size();
+
+        uint8_t event_buf[] = {SCHED_EVENT_PING, SCHED_EVENT_TIMEOUT};
+        for (int i = 0; i < SCHED_SM_CNT; i++) {
+            sm[i] = sh_sm_create_with_timer_pool(SH_GROUP(event_buf), sched_get_tick_ms, 2);
+            ASSERT_TRUE(sm[i]);
+            ASSERT_EQ(0, sh_sm_state_create(sm[i], 0));
+            ASSERT_EQ(0, sh_sm_state_subscribe_events(sm[i], 0, SH_GROUP(event_buf), sched_event_cb));
+            ASSERT_EQ(0, sh_sm_trans_to(sm[i], 0));
+        }
+
+        sched = sh_sched_create(3, 1000000);
+        ASSERT_TRUE(sched);
+    }
+
+    void TearDown()
+    {
+        sh_sched_destroy(sched);
+
+        for (int i = 0; i < SCHED_SM_CNT; i++) {
+            sh_sm_destroy(sm[i]);
+        }
+
+        EXPECT_EQ(free_size, sh_get_free_size());
+
+        sh_isr_unregister();
+        pthread_mutex_destroy(&sched_mutex);
+    }
+
+    bool wait_for(int id, int cnt)
+    {
+        for (int i = 0; i < 1000; i++) {
+            if (sched_event_cnt[id] >= cnt) {
+                return true;
+            }
+            usleep(1000);
+        }
+        return false;
+    }
+
+    sh_sched_t *sched;
+    sh_sm_t *sm[SCHED_SM_CNT];
+    int free_size;
+};
+
+TEST_F(TEST_SH_SCHED, sched_publish_test) {
+    for (int i = 0; i < SCHED_SM_CNT; i++) {
+        EXPECT_EQ(0, sh_sched_add(sched, sm[i]));
+    }
+
+    /* the queued messages live in the small sh_mem pool, publish in rounds */
+    for (int n = 0; n < 50; n++) {
+        for (int i = 0; i < SCHED_SM_CNT; i++) {
+            EXPECT_EQ(0, sh_sm_publish_event(sm[i], SCHED_EVENT_PING));
+        }
+        EXPECT_TRUE(wait_for(SCHED_EVENT_PING, (n + 1) * SCHED_SM_CNT));
+    }
+
+    /* idle sms are not run */
+    sh_sched_wait_idle(sched);
+    uint32_t run_cnt = sh_sched_get_run_count(sched);
+    usleep(50 * 1000);
+    EXPECT_EQ(run_cnt, sh_sched_get_run_count(sched));
+
+    for (int i = 0; i < SCHED_SM_CNT; i++) {
+        EXPECT_EQ(0, sh_sched_remove(sched, sm[i]));
+    }
+    EXPECT_EQ(-1, sh_sched_remove(sched, sm[0]));
+    EXPECT_EQ(50 * SCHED_SM_CNT, sched_event_cnt[SCHED_EVENT_PING]);
+}
+
+TEST_F(TEST_SH_SCHED, sched_timer_test) {
+    for (int i = 0; i < SCHED_SM_CNT; i++) {
+        EXPECT_EQ(0, sh_sched_add(sched, sm[i]));
+    }
+
+    for (int i = 0; i < SCHED_SM_CNT; i++) {
+        int level = sh_isr_disable();
+        EXPECT_LE(0, sh_sm_start_timer(sm[i], 10 + i * 10, SCHED_EVENT_TIMEOUT));
+        sh_isr_enable(level);
+    }
+
+    EXPECT_TRUE(wait_for(SCHED_EVENT_TIMEOUT, SCHED_SM_CNT));
+
+    sh_sched_wait_idle(sched);
+    uint32_t run_cnt = sh_sched_get_run_count(sched);
+    usleep(50 * 1000);
+    EXPECT_EQ(run_cnt, sh_sched_get_run_count(sched));
+    EXPECT_EQ(SCHED_SM_CNT, sched_event_cnt[SCHED_EVENT_TIMEOUT]);
+}
+
+TEST_F(TEST_SH_SCHED, sched_remove_queued_test) {
+    EXPECT_EQ(0, sh_sched_add(sched, sm[0]));
+
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(0, sh_sm_publish_event(sm[0], SCHED_EVENT_PING));
+    }
+
+    /* the sm may still sit in a worker deque */
+    EXPECT_EQ(0, sh_sched_remove(sched, sm[0]));
+
+    EXPECT_EQ(0, sh_sm_handler(sm[0]));
+    EXPECT_EQ(4, sched_event_cnt[SCHED_EVENT_PING]);
+}
+
+TEST_F(TEST_SH_SCHED, sched_remove_pending_timer_test) {
+    EXPECT_EQ(0, sh_sched_add(sched, sm[0]));
+
+    int level = sh_isr_disable();
+    EXPECT_LE(0, sh_sm_start_timer(sm[0], 30, SCHED_EVENT_TIMEOUT));
+    sh_isr_enable(level);
+
+    EXPECT_EQ(0, sh_sched_remove(sched, sm[0]));
+
+    usleep(60 * 1000);
+    EXPECT_EQ(0, sched_event_cnt[SCHED_EVENT_TIMEOUT]);
+
+    /* the sm can be driven by hand again */
+    EXPECT_EQ(0, sh_sm_handler(sm[0]));
+    EXPECT_EQ(1, sched_event_cnt[SCHED_EVENT_TIMEOUT]);
+}
+
+#endif
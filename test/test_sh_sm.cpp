@@ -27,14 +27,14 @@ uint8_t event_buf[] = {SH_EVENT_ONE, SH_EVENT_TWO, SH_EVENT_THREE};
 
 unsigned int timer_param[SH_EVENT_MAX] = {0};
 
-uint32_t current_tick = 0;
+sh_tick_t current_tick = 0;
 
-uint32_t get_tick_cnt(void)
+sh_tick_t get_tick_cnt(void)
 {
     return current_tick;
 }
 
-void test_sleep_tick(uint32_t increase_tick)
+void test_sleep_tick(sh_tick_t increase_tick)
 {
     current_tick += increase_tick;
 }
@@ -303,7 +303,7 @@ TEST_F(TEST_SH_SM, sm_private_timer_test) {
     EXPECT_EQ(1, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_TWO]);
     EXPECT_EQ(0, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_THREE]);
 
-    EXPECT_GT(free_size, sh_get_free_size());
+    EXPECT_EQ(free_size, sh_get_free_size());
 
     sh_sm_trans_to(sm, SH_SM_STATE_EXECUTE);
 
@@ -392,7 +392,7 @@ TEST_F(TEST_SH_SM, sm_private_timer_manual_destroy_test) {
     EXPECT_EQ(1, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_TWO]);
     EXPECT_EQ(0, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_THREE]);
 
-    EXPECT_GT(free_size, sh_get_free_size());
+    EXPECT_EQ(free_size, sh_get_free_size());
 
     EXPECT_EQ(0, sh_sm_remove_timer(sm, SH_SM_PRIVATE_TIMER, 2));
 
@@ -406,7 +406,7 @@ TEST_F(TEST_SH_SM, sm_private_timer_manual_remove_all_test) {
     EXPECT_EQ(1, sh_sm_start_timer(sm, 1000, SH_EVENT_TWO));
     EXPECT_EQ(2, sh_sm_start_timer(sm, 2000, SH_EVENT_THREE));
 
-    EXPECT_GT(free_size, sh_get_free_size());
+    EXPECT_EQ(free_size, sh_get_free_size());
 
     EXPECT_EQ(0, sh_sm_remove_state_all_timer(sm, SH_SM_STATE_ENTER));
 
@@ -438,7 +438,7 @@ TEST_F(TEST_SH_SM, sm_global_timer_manual_remove_test) {
     EXPECT_EQ(1, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_TWO]);
     EXPECT_EQ(0, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_THREE]);
 
-    EXPECT_GT(free_size, sh_get_free_size());
+    EXPECT_EQ(free_size, sh_get_free_size());
 
     EXPECT_EQ(0, sh_sm_remove_timer(sm, SH_SM_GLOBAL_TIMER, 2));
 
@@ -461,7 +461,7 @@ TEST_F(TEST_SH_SM, sm_global_timer_manual_remove_all_test) {
     EXPECT_EQ(1, sh_sm_start_global_timer(sm, 1000, SH_EVENT_TWO));
     EXPECT_EQ(2, sh_sm_start_global_timer(sm, 2000, SH_EVENT_THREE));
 
-    EXPECT_GT(free_size, sh_get_free_size());
+    EXPECT_EQ(free_size, sh_get_free_size());
 
     sh_sm_remove_all_global_timer(sm);
 
@@ -481,7 +481,7 @@ TEST_F(TEST_SH_SM, sh_sm_start_timer_with_param_test) {
     uint32_t free_size = sh_get_free_size();
     EXPECT_EQ(0, sh_sm_start_timer_with_param(sm, 500, SH_EVENT_ONE, (unsigned int)-11));
     EXPECT_EQ(1, sh_sm_start_timer_with_param(sm, 700, SH_EVENT_TWO, 101));
-    EXPECT_GT(free_size, sh_get_free_size());
+    EXPECT_EQ(free_size, sh_get_free_size());
 
     for (int i = 0; i < 1100; i++) {
         sh_sm_handler(sm);
@@ -514,5 +514,594 @@ TEST_F(TEST_SH_SM, sh_sm_publish_event_with_param_test) {
     EXPECT_EQ(101, timer_param[SH_EVENT_TWO]);
 }
 
+static sh_event_param_t typed_param[SH_EVENT_MAX];
+
+static void sh_sm_typed_param_cb(const sh_event_msg_t *e)
+{
+    typed_param[e->id] = *sh_sm_get_event_typed_param(e);
+}
+
+TEST_F(TEST_SH_SM, sh_sm_typed_param_test) {
+    uint8_t events[] = {SH_EVENT_ONE, SH_EVENT_TWO, SH_EVENT_THREE};
+    EXPECT_EQ(0, sh_sm_state_subscribe_events(sm, SH_SM_STATE_ENTER, SH_GROUP(events), sh_sm_typed_param_cb));
+    memset(typed_param, 0, sizeof(typed_param));
+
+    int ctx = 0;
+    sh_event_param_t param_ptr = {.ptr = &ctx};
+    sh_event_param_t param_buf = {.buf = {1, 2, 3, 4, 5, 6, 7, 8}};
+    sh_event_param_t param_i32 = {.i32 = -5};
+
+    /* an inline param costs no more than a plain event */
+    int free_size = sh_get_free_size();
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_THREE));
+    int plain_size = free_size - sh_get_free_size();
+    EXPECT_EQ(0, sh_sm_publish_event_with_typed_param(sm, SH_EVENT_ONE, &param_ptr));
+    EXPECT_EQ(free_size - 2 * plain_size, sh_get_free_size());
+
+    EXPECT_LE(0, sh_sm_start_timer_with_typed_param(sm, 100, SH_EVENT_TWO, &param_buf));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(&ctx, typed_param[SH_EVENT_ONE].ptr);
+
+    test_sleep_tick(100);
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(0, memcmp(param_buf.buf, typed_param[SH_EVENT_TWO].buf, SH_EVENT_PARAM_BUF_SIZE));
+
+    EXPECT_EQ(0, sh_sm_publish_event_with_typed_param(sm, SH_EVENT_THREE, &param_i32));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(-5, typed_param[SH_EVENT_THREE].i32);
+}
+
+
+
+
+TEST_F(TEST_SH_SM, sm_snapshot_test) {
+    uint8_t blob[128];
+    sh_tick_t ticks_until = 0;
+
+    EXPECT_EQ(0, sh_sm_trans_to(sm, SH_SM_STATE_EXECUTE));
+    EXPECT_LE(0, sh_sm_start_global_timer(sm, 50, SH_EVENT_ONE));
+    EXPECT_LE(0, sh_sm_start_timer(sm, 30, SH_EVENT_TWO));
+    EXPECT_EQ(0, sh_sm_publish_event_with_param(sm, SH_EVENT_THREE, 9));
+    test_sleep_tick(10);
+
+    int len = sh_sm_snapshot(sm, NULL, 0);
+    EXPECT_LT(0, len);
+    EXPECT_EQ(-1, sh_sm_snapshot(sm, blob, len - 1));
+    EXPECT_EQ(len, sh_sm_snapshot(sm, blob, sizeof(blob)));
+
+    /* a second sm with the same layout plays the restarted process */
+    sh_sm_t *sm2 = sh_sm_create(SH_GROUP(event_buf), get_tick_cnt);
+    ASSERT_TRUE(sm2);
+    EXPECT_EQ(0, sh_sm_state_create(sm2, SH_SM_STATE_ENTER));
+    EXPECT_EQ(0, sh_sm_state_create(sm2, SH_SM_STATE_EXECUTE));
+    EXPECT_EQ(0, sh_sm_state_subscribe_events(sm2, SH_SM_STATE_EXECUTE, SH_GROUP(event_buf), sh_sm_state_execute_cb));
+    EXPECT_EQ(0, sh_sm_trans_to(sm2, SH_SM_STATE_ENTER));
+    EXPECT_LE(0, sh_sm_start_global_timer(sm2, 5, SH_EVENT_THREE));
+
+    EXPECT_EQ(-1, sh_sm_restore(sm2, blob, len - 1));
+    blob[0] ^= 0xFF;
+    EXPECT_EQ(-1, sh_sm_restore(sm2, blob, len));
+    blob[0] ^= 0xFF;
+
+    test_sleep_tick(100);
+    EXPECT_EQ(0, sh_sm_restore(sm2, blob, len));
+    EXPECT_EQ(0, sh_sm_next_deadline(sm2, &ticks_until));
+    EXPECT_EQ(20, ticks_until);
+
+    EXPECT_EQ(0, sh_sm_handler(sm2));
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_EXECUTE][SH_EVENT_THREE]);
+
+    test_sleep_tick(20);
+    EXPECT_EQ(0, sh_sm_handler(sm2));
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_EXECUTE][SH_EVENT_TWO]);
+    EXPECT_EQ(0, event_cnt[SH_SM_STATE_EXECUTE][SH_EVENT_ONE]);
+
+    test_sleep_tick(20);
+    EXPECT_EQ(0, sh_sm_handler(sm2));
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_EXECUTE][SH_EVENT_ONE]);
+    EXPECT_EQ(-1, sh_sm_next_deadline(sm2, &ticks_until));
+
+    /* a state the target sm does not have */
+    EXPECT_EQ(0, sh_sm_trans_to(sm, SH_SM_STATE_EXIT));
+    len = sh_sm_snapshot(sm, blob, sizeof(blob));
+    EXPECT_EQ(-1, sh_sm_restore(sm2, blob, len));
+
+    sh_sm_destroy(sm2);
+}
+
+static sh_tick_t wait_timeout;
+static int wait_cnt;
+
+/* stands in for a blocking wait, it sleeps until the timeout */
+static void sh_sm_test_wait(sh_sm_t *sm, sh_tick_t timeout, void *arg)
+{
+    (void)sm;
+    (void)arg;
+
+    wait_timeout = timeout;
+    wait_cnt++;
+
+    if (timeout != SH_SM_WAIT_FOREVER) {
+        test_sleep_tick(timeout);
+    }
+}
+
+TEST_F(TEST_SH_SM, sm_wait_test) {
+    wait_cnt = 0;
+
+    EXPECT_FALSE(sh_sm_has_work(sm));
+    EXPECT_EQ(0, sh_sm_wait(sm, sh_sm_test_wait, NULL));
+    EXPECT_EQ(1, wait_cnt);
+    EXPECT_EQ(SH_SM_WAIT_FOREVER, wait_timeout);
+
+    /* a queued event returns at once */
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_ONE));
+    EXPECT_TRUE(sh_sm_has_work(sm));
+    EXPECT_EQ(0, sh_sm_wait(sm, sh_sm_test_wait, NULL));
+    EXPECT_EQ(1, wait_cnt);
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_FALSE(sh_sm_has_work(sm));
+
+    /* the earliest of the global and state timers bounds the wait */
+    EXPECT_LE(0, sh_sm_start_global_timer(sm, 50, SH_EVENT_TWO));
+    EXPECT_LE(0, sh_sm_start_timer(sm, 30, SH_EVENT_THREE));
+    EXPECT_FALSE(sh_sm_has_work(sm));
+    EXPECT_EQ(0, sh_sm_wait(sm, sh_sm_test_wait, NULL));
+    EXPECT_EQ(2, wait_cnt);
+    EXPECT_EQ(30, wait_timeout);
+    EXPECT_TRUE(sh_sm_has_work(sm));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_THREE]);
+
+    EXPECT_EQ(0, sh_sm_wait(sm, sh_sm_test_wait, NULL));
+    EXPECT_EQ(20, wait_timeout);
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_TWO]);
+    EXPECT_FALSE(sh_sm_has_work(sm));
+}
+
+TEST_F(TEST_SH_SM, sm_timer_pool_test) {
+    sh_sm_timer_id_t timer_id[SH_SM_TIMER_POOL_SIZE];
+    uint32_t free_size = sh_get_free_size();
+
+    /* the pool is shared by the states and the global timers */
+    for (int i = 0; i < SH_SM_TIMER_POOL_SIZE; i++) {
+        timer_id[i] = sh_sm_start_timer(sm, 100 + i, SH_EVENT_ONE);
+        EXPECT_EQ(i, timer_id[i]);
+    }
+    EXPECT_EQ(-1, sh_sm_start_timer(sm, 100, SH_EVENT_TWO));
+    EXPECT_EQ(-1, sh_sm_start_global_timer(sm, 100, SH_EVENT_TWO));
+
+    EXPECT_EQ(free_size, sh_get_free_size());
+
+    /* the node is reused with a new id, the old one stays invalid */
+    EXPECT_EQ(0, sh_sm_remove_timer(sm, SH_SM_PRIVATE_TIMER, timer_id[3]));
+    sh_sm_timer_id_t new_id = sh_sm_start_timer(sm, 50, SH_EVENT_ONE);
+    EXPECT_LE(0, new_id);
+    EXPECT_NE(timer_id[3], new_id);
+    EXPECT_EQ(-1, sh_sm_remove_timer(sm, SH_SM_PRIVATE_TIMER, timer_id[3]));
+
+    for (int i = 0; i < 200; i++) {
+        sh_sm_handler(sm);
+        test_sleep_tick(1);
+    }
+
+    EXPECT_EQ(SH_SM_TIMER_POOL_SIZE, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_ONE]);
+    EXPECT_EQ(free_size, sh_get_free_size());
+    EXPECT_LE(0, sh_sm_start_global_timer(sm, 100, SH_EVENT_TWO));
+    sh_sm_remove_all_global_timer(sm);
+}
+
+TEST(TEST_SH_SM_TIMER_ID, sm_timer_id_test) {
+    const int timer_cnt = 40;
+    sh_sm_timer_id_t timer_id[timer_cnt];
+
+    memset(event_cnt, 0, sizeof(event_cnt));
+    current_tick = 0;
+    int free_size = sh_get_free_size();
+
+    sh_sm_t *sm = sh_sm_create_with_timer_pool(SH_GROUP(event_buf), get_tick_cnt, timer_cnt);
+    ASSERT_TRUE(sm);
+    ASSERT_EQ(0, sh_sm_state_create(sm, SH_SM_STATE_ENTER));
+    ASSERT_EQ(0, sh_sm_state_subscribe_event(sm, SH_SM_STATE_ENTER, SH_EVENT_ONE, sh_sm_state_enter_cb));
+    ASSERT_EQ(0, sh_sm_trans_to(sm, SH_SM_STATE_ENTER));
+
+    /* more than 32 timers in one state */
+    for (int i = 0; i < timer_cnt; i++) {
+        timer_id[i] = sh_sm_start_timer(sm, 100 + i, SH_EVENT_ONE);
+        EXPECT_EQ(i, timer_id[i]);
+    }
+    EXPECT_EQ(-1, sh_sm_start_timer(sm, 100, SH_EVENT_ONE));
+
+    for (int i = 0; i < timer_cnt; i += 2) {
+        EXPECT_EQ(0, sh_sm_remove_timer(sm, SH_SM_PRIVATE_TIMER, timer_id[i]));
+    }
+    EXPECT_EQ(-1, sh_sm_remove_timer(sm, SH_SM_PRIVATE_TIMER, timer_id[0]));
+    EXPECT_EQ(-1, sh_sm_remove_timer(sm, SH_SM_GLOBAL_TIMER, timer_id[1]));
+    EXPECT_EQ(-1, sh_sm_remove_timer(sm, SH_SM_PRIVATE_TIMER, timer_cnt));
+    EXPECT_EQ(-1, sh_sm_remove_timer(sm, SH_SM_PRIVATE_TIMER, -1));
+
+    /* a reused node gets a new id, the old one stays invalid */
+    sh_sm_timer_id_t new_id = sh_sm_start_global_timer(sm, 50, SH_EVENT_ONE);
+    EXPECT_LE(0, new_id);
+    EXPECT_NE(timer_id[0], new_id);
+    EXPECT_EQ(-1, sh_sm_remove_timer(sm, SH_SM_GLOBAL_TIMER, timer_id[0]));
+
+    for (int i = 0; i < 200; i++) {
+        EXPECT_EQ(0, sh_sm_handler(sm));
+        test_sleep_tick(1);
+    }
+    EXPECT_EQ(timer_cnt / 2 + 1, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_ONE]);
+    EXPECT_EQ(-1, sh_sm_remove_timer(sm, SH_SM_GLOBAL_TIMER, new_id));
+
+    sh_sm_destroy(sm);
+    EXPECT_EQ(free_size, sh_get_free_size());
+}
+
+TEST_F(TEST_SH_SM, sm_state_table_test) {
+    EXPECT_EQ(-1, sh_sm_state_create(sm, SH_SM_STATE_EXIT));
+    EXPECT_EQ(-1, sh_sm_trans_to(sm, 60));
+
+    EXPECT_EQ(0, sh_sm_state_create(sm, 60));
+    EXPECT_EQ(0, sh_sm_state_subscribe_event(sm, 60, SH_EVENT_TWO, sh_sm_state_exit_cb));
+    EXPECT_EQ(0, sh_sm_trans_to(sm, 60));
+
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_TWO));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_EXIT][SH_EVENT_TWO]);
+
+    EXPECT_EQ(0, sh_sm_trans_to(sm, SH_SM_STATE_ENTER));
+    EXPECT_EQ(0, sh_sm_state_destroy(sm, 60));
+    EXPECT_EQ(-1, sh_sm_trans_to(sm, 60));
+    EXPECT_EQ(-1, sh_sm_state_destroy(sm, 200));
+}
+
+static char action_log[32];
+static int action_cnt = 0;
+
+static void sh_sm_entry_action(sh_sm_t *sm, uint8_t state_id)
+{
+    (void)sm;
+    action_log[action_cnt++] = 'a' + state_id;
+}
+
+static void sh_sm_exit_action(sh_sm_t *sm, uint8_t state_id)
+{
+    (void)sm;
+    action_log[action_cnt++] = 'A' + state_id;
+}
+
+TEST_F(TEST_SH_SM, sm_hsm_bubble_test) {
+    EXPECT_EQ(0, sh_sm_state_create(sm, 10));
+    EXPECT_EQ(0, sh_sm_state_set_parent(sm, 10, SH_SM_STATE_EXIT));
+    EXPECT_EQ(0, sh_sm_state_subscribe_event(sm, 10, SH_EVENT_TWO, sh_sm_state_execute_cb));
+    EXPECT_EQ(0, sh_sm_trans_to(sm, 10));
+
+    /* one is handled by the parent, two by the child itself */
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_ONE));
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_TWO));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_EXIT][SH_EVENT_ONE]);
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_EXECUTE][SH_EVENT_TWO]);
+
+    /* a handler added to the parent later reaches the child too */
+    EXPECT_EQ(0, sh_sm_state_subscribe_event(sm, SH_SM_STATE_EXIT, SH_EVENT_THREE, sh_sm_state_exit_cb));
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_THREE));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_EXIT][SH_EVENT_THREE]);
+
+    /* the child unsubscribing falls back to the parent */
+    EXPECT_EQ(0, sh_sm_state_subscribe_event(sm, 10, SH_EVENT_ONE, sh_sm_state_execute_cb));
+    EXPECT_EQ(0, sh_sm_state_unsubscribe_event(sm, 10, SH_EVENT_ONE));
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_ONE));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(2, event_cnt[SH_SM_STATE_EXIT][SH_EVENT_ONE]);
+    EXPECT_EQ(0, event_cnt[SH_SM_STATE_EXECUTE][SH_EVENT_ONE]);
+
+    /* destroying the parent leaves the child on its own handlers */
+    EXPECT_EQ(0, sh_sm_state_destroy(sm, SH_SM_STATE_EXIT));
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_ONE));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(2, event_cnt[SH_SM_STATE_EXIT][SH_EVENT_ONE]);
+}
+
+TEST_F(TEST_SH_SM, sm_hsm_action_test) {
+    /*
+     *        0
+     *      /   \
+     *     1     2
+     *     |
+     *     3
+     */
+    EXPECT_EQ(0, sh_sm_state_create(sm, 3));
+    EXPECT_EQ(0, sh_sm_state_set_parent(sm, 1, 0));
+    EXPECT_EQ(0, sh_sm_state_set_parent(sm, 2, 0));
+    EXPECT_EQ(0, sh_sm_state_set_parent(sm, 3, 1));
+
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(0, sh_sm_state_set_action(sm, i, sh_sm_entry_action, sh_sm_exit_action));
+    }
+    EXPECT_EQ(-1, sh_sm_state_set_action(sm, 4, sh_sm_entry_action, NULL));
+
+    memset(action_log, 0, sizeof(action_log));
+    action_cnt = 0;
+
+    EXPECT_EQ(0, sh_sm_trans_to(sm, 3));
+    EXPECT_STREQ("bd", action_log);
 
+    EXPECT_EQ(0, sh_sm_trans_to(sm, 2));
+    EXPECT_STREQ("bdDBc", action_log);
+
+    EXPECT_EQ(0, sh_sm_trans_to(sm, 2));
+    EXPECT_STREQ("bdDBcCc", action_log);
+
+    /* a transition to an ancestor is local, the ancestor stays active */
+    EXPECT_EQ(0, sh_sm_trans_to(sm, 0));
+    EXPECT_STREQ("bdDBcCcC", action_log);
+}
+
+TEST_F(TEST_SH_SM, sm_hsm_parent_invalid_test) {
+    EXPECT_EQ(-1, sh_sm_state_set_parent(sm, 1, 1));
+    EXPECT_EQ(-1, sh_sm_state_set_parent(sm, 1, 9));
+    EXPECT_EQ(0, sh_sm_state_set_parent(sm, 1, 0));
+    EXPECT_EQ(0, sh_sm_state_set_parent(sm, 2, 1));
+    EXPECT_EQ(-1, sh_sm_state_set_parent(sm, 0, 2));
+
+    for (int i = 3; i < SH_SM_DEPTH_MAX; i++) {
+        EXPECT_EQ(0, sh_sm_state_create(sm, i));
+        EXPECT_EQ(0, sh_sm_state_set_parent(sm, i, i - 1));
+    }
+    EXPECT_EQ(0, sh_sm_state_create(sm, SH_SM_DEPTH_MAX));
+    EXPECT_EQ(-1, sh_sm_state_set_parent(sm, SH_SM_DEPTH_MAX, SH_SM_DEPTH_MAX - 1));
+}
+
+TEST(TEST_SH_SM_TABLE, sm_table_dispatch_test) {
+    memset(event_cnt, 0, sizeof(event_cnt));
+    int free_size = sh_get_free_size();
+
+    sh_sm_t *sm = sh_sm_create(SH_GROUP(event_buf), get_tick_cnt);
+    ASSERT_TRUE(sm);
+
+    EXPECT_EQ(0, sh_sm_set_dispatch_mode(sm, SH_SM_DISPATCH_TABLE));
+    EXPECT_EQ(0, sh_sm_state_create(sm, SH_SM_STATE_ENTER));
+    EXPECT_EQ(-1, sh_sm_set_dispatch_mode(sm, SH_SM_DISPATCH_SERVER));
+
+    EXPECT_EQ(0, sh_sm_state_subscribe_event(sm, SH_SM_STATE_ENTER, SH_EVENT_ONE, sh_sm_state_enter_cb));
+    EXPECT_EQ(0, sh_sm_trans_to(sm, SH_SM_STATE_ENTER));
+
+    /* growing the table keeps the current row */
+    EXPECT_EQ(0, sh_sm_state_create(sm, 20));
+    EXPECT_EQ(0, sh_sm_state_subscribe_event(sm, 20, SH_EVENT_TWO, sh_sm_state_exit_cb));
+
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_ONE));
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_TWO));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_ONE]);
+    EXPECT_EQ(0, event_cnt[SH_SM_STATE_EXIT][SH_EVENT_TWO]);
 
+    /* pending events follow the current state */
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_TWO));
+    EXPECT_EQ(0, sh_sm_trans_to(sm, 20));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(1, event_cnt[SH_SM_STATE_EXIT][SH_EVENT_TWO]);
+
+    /* the parent row is inherited as in server mode */
+    EXPECT_EQ(0, sh_sm_state_set_parent(sm, 20, SH_SM_STATE_ENTER));
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_ONE));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+    EXPECT_EQ(2, event_cnt[SH_SM_STATE_ENTER][SH_EVENT_ONE]);
+
+    EXPECT_EQ(0, sh_sm_state_destroy(sm, 20));
+    EXPECT_EQ(-1, sh_sm_handler(sm));
+
+    sh_sm_destroy(sm);
+    EXPECT_EQ(free_size, sh_get_free_size());
+}
+
+static uint32_t inst_event_cnt[SH_EVENT_MAX] = {0};
+static unsigned int inst_param = 0;
+
+static void sh_sm_inst_event_cb(sh_sm_inst_t *inst, const sh_event_msg_t *e)
+{
+    (void)inst;
+    inst_event_cnt[e->id]++;
+    inst_param = sh_sm_get_event_param(e);
+}
+
+TEST(TEST_SH_SM_DEF, sm_def_inst_test) {
+    enum { IDLE = 0, BUSY, STATE_CNT };
+    const int inst_cnt = 50;
+
+    memset(inst_event_cnt, 0, sizeof(inst_event_cnt));
+    current_tick = 0;
+    int free_size = sh_get_free_size();
+
+    sh_sm_def_t *def = sh_sm_def_create(STATE_CNT, SH_GROUP(event_buf), get_tick_cnt);
+    ASSERT_TRUE(def);
+
+    EXPECT_EQ(0, sh_sm_def_subscribe_event(def, IDLE, SH_EVENT_ONE, sh_sm_inst_event_cb));
+    EXPECT_EQ(0, sh_sm_def_add_transition(def, IDLE, SH_EVENT_ONE, BUSY));
+    EXPECT_EQ(0, sh_sm_def_subscribe_event(def, BUSY, SH_EVENT_TWO, sh_sm_inst_event_cb));
+    EXPECT_EQ(0, sh_sm_def_add_transition(def, BUSY, SH_EVENT_THREE, IDLE));
+    EXPECT_EQ(-1, sh_sm_def_add_transition(def, BUSY, SH_EVENT_THREE, STATE_CNT));
+    EXPECT_EQ(-1, sh_sm_def_subscribe_event(def, STATE_CNT, SH_EVENT_ONE, sh_sm_inst_event_cb));
+    EXPECT_EQ(-1, sh_sm_def_subscribe_event(def, IDLE, SH_EVENT_MAX, sh_sm_inst_event_cb));
+
+    sh_sm_inst_t inst[inst_cnt];
+    sh_event_msg_t queue[inst_cnt][4];
+    int def_free_size = sh_get_free_size();
+
+    for (int i = 0; i < inst_cnt; i++) {
+        EXPECT_EQ(0, sh_sm_inst_init(&inst[i], def, queue[i], 4, IDLE));
+    }
+    EXPECT_EQ(def_free_size, sh_get_free_size());
+
+    /* events without a callback or transition are dropped */
+    EXPECT_EQ(0, sh_sm_inst_publish_event(&inst[0], SH_EVENT_TWO, 0));
+    EXPECT_EQ(0, sh_sm_inst_publish_event(&inst[0], SH_EVENT_ONE, 7));
+    EXPECT_EQ(0, sh_sm_inst_publish_event(&inst[0], SH_EVENT_TWO, 8));
+    EXPECT_EQ(-1, sh_sm_inst_publish_event(&inst[0], SH_EVENT_TWO, 9));
+    EXPECT_EQ(0, sh_sm_inst_handler(&inst[0]));
+    EXPECT_EQ(BUSY, inst[0].state);
+    EXPECT_EQ(1, inst_event_cnt[SH_EVENT_ONE]);
+    EXPECT_EQ(1, inst_event_cnt[SH_EVENT_TWO]);
+    EXPECT_EQ(8, inst_param);
+    EXPECT_EQ(IDLE, inst[1].state);
+
+    /* the state timers of every instance share one list */
+    sh_list_t timer_head;
+    sh_list_init(&timer_head);
+
+    for (int i = 0; i < inst_cnt; i++) {
+        EXPECT_EQ(0, sh_sm_inst_start_timer(&inst[i], &timer_head, 10 + i, SH_EVENT_THREE));
+    }
+    /* leaving a state stops its timer */
+    EXPECT_EQ(0, sh_sm_inst_trans_to(&inst[1], BUSY));
+
+    current_tick = 100;
+    sh_timer_handler(&timer_head);
+    for (int i = 0; i < inst_cnt; i++) {
+        EXPECT_EQ(0, sh_sm_inst_handler(&inst[i]));
+        EXPECT_EQ((i == 1) ? BUSY : IDLE, inst[i].state);
+    }
+    EXPECT_TRUE(sh_list_isempty(&timer_head));
+
+    for (int i = 0; i < inst_cnt; i++) {
+        sh_sm_inst_deinit(&inst[i]);
+    }
+
+    sh_sm_inst_t *heap_inst = sh_sm_inst_create(def, 4, BUSY);
+    ASSERT_TRUE(heap_inst);
+    EXPECT_EQ(0, sh_sm_inst_publish_event(heap_inst, SH_EVENT_THREE, 0));
+    EXPECT_EQ(0, sh_sm_inst_handler(heap_inst));
+    EXPECT_EQ(IDLE, heap_inst->state);
+    sh_sm_inst_destroy(heap_inst);
+
+    sh_sm_def_destroy(def);
+    EXPECT_EQ(free_size, sh_get_free_size());
+}
+
+static sh_list_t inst_timer_head;
+
+/* sends the request and arms the retry of the state it moves to */
+static void sh_sm_inst_request_cb(sh_sm_inst_t *inst, const sh_event_msg_t *e)
+{
+    inst_event_cnt[e->id]++;
+    sh_sm_inst_start_timer(inst, &inst_timer_head, 10, SH_EVENT_THREE);
+}
+
+TEST(TEST_SH_SM_DEF, sm_def_inst_trans_timer_test) {
+    enum { IDLE = 0, WAIT, STATE_CNT };
+
+    memset(inst_event_cnt, 0, sizeof(inst_event_cnt));
+    current_tick = 0;
+    int free_size = sh_get_free_size();
+
+    sh_sm_def_t *def = sh_sm_def_create(STATE_CNT, SH_GROUP(event_buf), get_tick_cnt);
+    ASSERT_TRUE(def);
+
+    EXPECT_EQ(0, sh_sm_def_subscribe_event(def, IDLE, SH_EVENT_ONE, sh_sm_inst_request_cb));
+    EXPECT_EQ(0, sh_sm_def_add_transition(def, IDLE, SH_EVENT_ONE, WAIT));
+    EXPECT_EQ(0, sh_sm_def_subscribe_event(def, WAIT, SH_EVENT_THREE, sh_sm_inst_request_cb));
+    EXPECT_EQ(0, sh_sm_def_add_transition(def, WAIT, SH_EVENT_TWO, IDLE));
+
+    sh_sm_inst_t inst;
+    sh_event_msg_t queue[4];
+    sh_list_init(&inst_timer_head);
+    EXPECT_EQ(0, sh_sm_inst_init(&inst, def, queue, 4, IDLE));
+
+    /* the timer armed by the callback survives the transition */
+    EXPECT_EQ(0, sh_sm_inst_publish_event(&inst, SH_EVENT_ONE, 0));
+    EXPECT_EQ(0, sh_sm_inst_handler(&inst));
+    EXPECT_EQ(WAIT, inst.state);
+    EXPECT_FALSE(sh_list_isempty(&inst_timer_head));
+
+    /* the retry re-arms itself while the state is kept */
+    current_tick = 10;
+    sh_timer_handler(&inst_timer_head);
+    EXPECT_EQ(0, sh_sm_inst_handler(&inst));
+    EXPECT_EQ(WAIT, inst.state);
+    EXPECT_EQ(1, inst_event_cnt[SH_EVENT_THREE]);
+    EXPECT_FALSE(sh_list_isempty(&inst_timer_head));
+
+    /* a transition without a callback still stops the timer */
+    EXPECT_EQ(0, sh_sm_inst_publish_event(&inst, SH_EVENT_TWO, 0));
+    EXPECT_EQ(0, sh_sm_inst_handler(&inst));
+    EXPECT_EQ(IDLE, inst.state);
+    EXPECT_TRUE(sh_list_isempty(&inst_timer_head));
+
+    sh_sm_inst_deinit(&inst);
+    sh_sm_def_destroy(def);
+    EXPECT_EQ(free_size, sh_get_free_size());
+}
+
+#if USE_SH_SM_TRACE
+static sh_sm_t *trace_sm = NULL;
+
+static void sh_sm_trace_cb(const sh_event_msg_t *e)
+{
+    (void)e;
+    test_sleep_tick(3);
+    sh_sm_trans_to(trace_sm, SH_SM_STATE_EXECUTE);
+}
+
+TEST_F(TEST_SH_SM, sm_trace_test) {
+    sh_sm_trace_rec_t rec;
+    char json[1024];
+
+    trace_sm = sm;
+    EXPECT_EQ(0, sh_sm_trace_get_count(sm));
+    EXPECT_EQ(0, sh_sm_trace_enable(sm, 4));
+    EXPECT_EQ(0, sh_sm_state_subscribe_event(sm, SH_SM_STATE_ENTER, SH_EVENT_TWO, sh_sm_trace_cb));
+
+    test_sleep_tick(10);
+    EXPECT_EQ(0, sh_sm_publish_event(sm, SH_EVENT_TWO));
+    EXPECT_EQ(0, sh_sm_handler(sm));
+
+    /* the transition is recorded from inside the callback */
+    EXPECT_EQ(2, sh_sm_trace_get_count(sm));
+    EXPECT_EQ(0, sh_sm_trace_get(sm, 0, &rec));
+    EXPECT_EQ(SH_SM_TRACE_TRANS, rec.type);
+    EXPECT_EQ(13, rec.tick);
+    EXPECT_EQ(SH_SM_STATE_ENTER, rec.from);
+    EXPECT_EQ(SH_SM_STATE_EXECUTE, rec.to);
+    EXPECT_EQ(SH_EVENT_TWO, rec.event);
+
+    EXPECT_EQ(0, sh_sm_trace_get(sm, 1, &rec));
+    EXPECT_EQ(SH_SM_TRACE_EVENT, rec.type);
+    EXPECT_EQ(10, rec.tick);
+    EXPECT_EQ(3, rec.dur);
+    EXPECT_EQ(SH_SM_STATE_ENTER, rec.from);
+    EXPECT_EQ(SH_SM_STATE_EXECUTE, rec.to);
+    EXPECT_EQ(-1, sh_sm_trace_get(sm, 2, &rec));
+
+    test_sleep_tick(7);
+    EXPECT_EQ(13, sh_sm_trace_get_residency(sm, SH_SM_STATE_ENTER));
+    EXPECT_EQ(7, sh_sm_trace_get_residency(sm, SH_SM_STATE_EXECUTE));
+    EXPECT_EQ(3, sh_sm_trace_get_cb_tick(sm, SH_SM_STATE_ENTER, SH_EVENT_TWO));
+    EXPECT_EQ(0, sh_sm_trace_get_cb_tick(sm, SH_SM_STATE_EXECUTE, SH_EVENT_TWO));
+
+    /* the ring keeps the newest records */
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(0, sh_sm_trans_to(sm, SH_SM_STATE_EXIT));
+    }
+    EXPECT_EQ(4, sh_sm_trace_get_count(sm));
+    EXPECT_EQ(0, sh_sm_trace_get(sm, 0, &rec));
+    EXPECT_EQ(SH_SM_TRACE_EVENT, rec.type);
+    EXPECT_EQ(0, sh_sm_trace_get(sm, 3, &rec));
+    EXPECT_EQ(SH_SM_STATE_EXIT, rec.from);
+    EXPECT_EQ(SH_SM_TRACE_NO_EVENT, rec.event);
+
+    int len = sh_sm_trace_export(sm, json, sizeof(json), 1000);
+    EXPECT_LT(0, len);
+    EXPECT_EQ(len, (int)strlen(json));
+    EXPECT_EQ(0, strncmp(json, "{\"traceEvents\":[", 16));
+    EXPECT_EQ(0, strcmp(json + len - 2, "]}"));
+    EXPECT_TRUE(strstr(json, "\"name\":\"state 0 event 1\",\"ph\":\"X\",\"ts\":10000,\"dur\":3000"));
+    EXPECT_TRUE(strstr(json, "\"name\":\"1 -> 2\""));
+    EXPECT_EQ(-1, sh_sm_trace_export(sm, json, 32, 1000));
+
+    sh_sm_trace_disable(sm);
+    EXPECT_EQ(0, sh_sm_trace_get_count(sm));
+}
+#endif
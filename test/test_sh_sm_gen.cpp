@@ -0,0 +1,178 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include "sh_sm_gen.h"
+#include "sh_lib.h"
+
+using namespace testing;
+
+enum {
+    GEN_STATE_OFF = 0,
+    GEN_STATE_ON,
+    GEN_STATE_LOCKED,
+};
+
+enum {
+    GEN_EVENT_PRESS = 0,
+    GEN_EVENT_LOCK,
+    GEN_EVENT_TIMEOUT,
+};
+
+#define GEN_TIMEOUT_TICK    100
+
+static sh_tick_t gen_tick = 0;
+static sh_list_t gen_timer_head;
+static int gen_on_cnt;
+static int gen_off_cnt;
+static bool gen_allow;
+
+static sh_tick_t gen_get_tick(void)
+{
+    return gen_tick;
+}
+
+SH_SM_GEN_DECLARE(gen_led, 4)
+
+static bool gen_allowed(gen_led_t *sm, const sh_event_msg_t *e)
+{
+    (void)sm;
+    (void)e;
+    return gen_allow;
+}
+
+static void gen_turn_on(gen_led_t *sm, const sh_event_msg_t *e)
+{
+    (void)sm;
+    gen_on_cnt += e->param.u32;
+}
+
+static void gen_turn_off(gen_led_t *sm, const sh_event_msg_t *e)
+{
+    (void)sm;
+    (void)e;
+    gen_off_cnt++;
+}
+
+static void gen_start_timeout(gen_led_t *sm, const sh_event_msg_t *e)
+{
+    (void)e;
+    gen_led_start_timer(sm, &gen_timer_head, GEN_TIMEOUT_TICK, GEN_EVENT_TIMEOUT);
+}
+
+#define GEN_LED_TABLE(X)                                                                    \
+    X(GEN_STATE_OFF,    GEN_EVENT_PRESS,   gen_allowed,      gen_turn_on,       GEN_STATE_ON)     \
+    X(GEN_STATE_ON,     GEN_EVENT_PRESS,   SH_SM_GEN_ALWAYS, gen_start_timeout, SH_SM_STATE_NONE) \
+    X(GEN_STATE_ON,     GEN_EVENT_TIMEOUT, SH_SM_GEN_ALWAYS, gen_turn_off,      GEN_STATE_OFF)    \
+    X(GEN_STATE_ON,     GEN_EVENT_LOCK,    SH_SM_GEN_ALWAYS, SH_SM_GEN_NO_ACTION, GEN_STATE_LOCKED) \
+    X(GEN_STATE_LOCKED, GEN_EVENT_LOCK,    SH_SM_GEN_ALWAYS, SH_SM_GEN_NO_ACTION, GEN_STATE_ON)     \
+    X(GEN_STATE_LOCKED, GEN_EVENT_PRESS,   gen_allowed,      gen_turn_on,       GEN_STATE_ON)     \
+    X(GEN_STATE_LOCKED, GEN_EVENT_PRESS,   SH_SM_GEN_ALWAYS, gen_turn_off,      GEN_STATE_OFF)
+
+SH_SM_GEN_DEFINE(gen_led, GEN_LED_TABLE)
+
+class TEST_SH_SM_GEN : public testing::Test {
+protected:
+    void SetUp()
+    {
+        gen_tick = 0;
+        gen_on_cnt = 0;
+        gen_off_cnt = 0;
+        gen_allow = true;
+
+        free_size = sh_get_free_size();
+
+        sh_timer_sys_init(gen_get_tick);
+        sh_list_init(&gen_timer_head);
+        gen_led_init(&led, GEN_STATE_OFF);
+    }
+
+    void TearDown()
+    {
+        gen_led_deinit(&led);
+
+        /* nothing is allocated */
+        EXPECT_EQ(free_size, sh_get_free_size());
+    }
+
+    gen_led_t led;
+    int free_size;
+};
+
+TEST_F(TEST_SH_SM_GEN, sm_gen_dispatch_test) {
+    sh_event_msg_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+
+    /* the guard blocks the row */
+    gen_allow = false;
+    msg.id = GEN_EVENT_PRESS;
+    EXPECT_EQ(1, gen_led_dispatch(&led, &msg));
+    EXPECT_EQ(GEN_STATE_OFF, led.state);
+
+    gen_allow = true;
+    msg.param.u32 = 2;
+    EXPECT_EQ(0, gen_led_dispatch(&led, &msg));
+    EXPECT_EQ(GEN_STATE_ON, led.state);
+    EXPECT_EQ(2, gen_on_cnt);
+
+    /* no row for the pair */
+    msg.id = GEN_EVENT_TIMEOUT;
+    led.state = GEN_STATE_LOCKED;
+    EXPECT_EQ(-1, gen_led_dispatch(&led, &msg));
+    EXPECT_EQ(GEN_STATE_LOCKED, led.state);
+}
+
+TEST_F(TEST_SH_SM_GEN, sm_gen_queue_timer_test) {
+    EXPECT_EQ(0, gen_led_publish(&led, GEN_EVENT_PRESS, 1));
+    EXPECT_EQ(0, gen_led_publish(&led, GEN_EVENT_PRESS, 0));
+    EXPECT_EQ(0, gen_led_publish(&led, GEN_EVENT_LOCK, 0));
+    EXPECT_EQ(-1, gen_led_publish(&led, GEN_EVENT_LOCK, 0));
+    EXPECT_EQ(0, gen_led_handler(&led));
+    EXPECT_EQ(1, gen_on_cnt);
+    EXPECT_EQ(GEN_STATE_LOCKED, led.state);
+
+    /* leaving the state stopped the timer of the internal transition */
+    gen_tick += GEN_TIMEOUT_TICK;
+    sh_timer_handler(&gen_timer_head);
+    EXPECT_EQ(0, gen_led_handler(&led));
+    EXPECT_EQ(0, gen_off_cnt);
+
+    EXPECT_EQ(0, gen_led_publish(&led, GEN_EVENT_LOCK, 0));
+    EXPECT_EQ(0, gen_led_publish(&led, GEN_EVENT_PRESS, 0));
+    EXPECT_EQ(0, gen_led_handler(&led));
+    EXPECT_EQ(GEN_STATE_ON, led.state);
+
+    gen_tick += GEN_TIMEOUT_TICK - 1;
+    sh_timer_handler(&gen_timer_head);
+    EXPECT_EQ(0, gen_led_handler(&led));
+    EXPECT_EQ(GEN_STATE_ON, led.state);
+
+    gen_tick += 1;
+    sh_timer_handler(&gen_timer_head);
+    EXPECT_EQ(0, gen_led_handler(&led));
+    EXPECT_EQ(GEN_STATE_OFF, led.state);
+    EXPECT_EQ(1, gen_off_cnt);
+}
+
+TEST_F(TEST_SH_SM_GEN, sm_gen_guarded_rows_test) {
+    sh_event_msg_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.id = GEN_EVENT_PRESS;
+    msg.param.u32 = 1;
+
+    /* the first row whose guard holds wins */
+    led.state = GEN_STATE_LOCKED;
+    EXPECT_EQ(0, gen_led_dispatch(&led, &msg));
+    EXPECT_EQ(GEN_STATE_ON, led.state);
+    EXPECT_EQ(1, gen_on_cnt);
+    EXPECT_EQ(0, gen_off_cnt);
+
+    /* otherwise the next row of the pair is tried */
+    gen_allow = false;
+    led.state = GEN_STATE_LOCKED;
+    EXPECT_EQ(0, gen_led_dispatch(&led, &msg));
+    EXPECT_EQ(GEN_STATE_OFF, led.state);
+    EXPECT_EQ(1, gen_on_cnt);
+    EXPECT_EQ(1, gen_off_cnt);
+}
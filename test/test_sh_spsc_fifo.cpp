@@ -0,0 +1,136 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include <thread>
+
+#include "sh_spsc_fifo.h"
+
+using namespace testing;
+
+#define SPSC_SIZE   8
+
+#define SPSC_USED_SIZE_TEST(used) \
+            EXPECT_EQ(sh_spsc_fifo_get_unused_size(fifo), (SPSC_SIZE) - (used)); \
+            EXPECT_EQ(sh_spsc_fifo_get_used_size(fifo), (used));
+
+class TEST_SH_SPSC_FIFO : public testing::Test {
+protected:  
+    void SetUp()
+    {
+        mem_size = sh_get_free_size();
+
+        fifo = sh_spsc_fifo_create(SPSC_SIZE, 1);
+        ASSERT_TRUE(fifo);
+
+        SPSC_USED_SIZE_TEST(0);
+    }
+
+    void TearDown()
+    {
+        sh_spsc_fifo_destroy(fifo);
+
+        EXPECT_EQ(mem_size, sh_get_free_size());
+    }
+
+    sh_spsc_fifo_t *fifo = NULL;
+    uint32_t mem_size;
+    uint8_t buf_in[10] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A};
+    uint8_t buf_out[10] = {0};
+};
+
+TEST_F(TEST_SH_SPSC_FIFO, spsc_create_test) {
+    EXPECT_FALSE(sh_spsc_fifo_create(0, 1));
+    EXPECT_FALSE(sh_spsc_fifo_create(10, 1));
+    EXPECT_FALSE(sh_spsc_fifo_create(8, 0));
+}
+
+TEST_F(TEST_SH_SPSC_FIFO, spsc_init_test) {
+    static sh_spsc_fifo_t static_fifo;
+    static uint16_t data[4];
+    uint16_t in[6] = {1, 2, 3, 4, 5, 6};
+    uint16_t out[6] = {0};
+
+    EXPECT_EQ(-1, sh_spsc_fifo_init(&static_fifo, data, 3, sizeof(uint16_t)));
+    EXPECT_EQ(-1, sh_spsc_fifo_init(&static_fifo, data, 4, 0));
+    EXPECT_EQ(0, sh_spsc_fifo_init(&static_fifo, data, 4, sizeof(uint16_t)));
+    EXPECT_EQ(4, sh_spsc_fifo_get_unused_size(&static_fifo));
+
+    EXPECT_EQ(3, sh_spsc_fifo_in(&static_fifo, in, 3));
+    EXPECT_EQ(2, sh_spsc_fifo_out(&static_fifo, out, 2));
+    EXPECT_EQ(3, sh_spsc_fifo_in(&static_fifo, in + 3, 6));
+    EXPECT_EQ(4, sh_spsc_fifo_out(&static_fifo, out + 2, 6));
+    for (int i = 0; i < 6; i++) {
+        EXPECT_EQ(in[i], out[i]);
+    }
+    EXPECT_EQ(0, sh_spsc_fifo_get_used_size(&static_fifo));
+}
+
+TEST_F(TEST_SH_SPSC_FIFO, spsc_in_out_test) {
+    EXPECT_EQ(SPSC_SIZE, sh_spsc_fifo_in(fifo, buf_in, 10));
+    SPSC_USED_SIZE_TEST(SPSC_SIZE);
+    EXPECT_EQ(0, sh_spsc_fifo_in(fifo, buf_in, 1));
+
+    EXPECT_EQ(3, sh_spsc_fifo_out_peek(fifo, buf_out, 3));
+    SPSC_USED_SIZE_TEST(SPSC_SIZE);
+    EXPECT_EQ(5, sh_spsc_fifo_out(fifo, buf_out, 5));
+    SPSC_USED_SIZE_TEST(3);
+    for (int i = 0; i < 5; i++) {
+        EXPECT_EQ(buf_out[i], i + 1);
+    }
+
+    /* wraps around the end of the buffer */
+    EXPECT_EQ(5, sh_spsc_fifo_in(fifo, buf_in, 6));
+    SPSC_USED_SIZE_TEST(SPSC_SIZE);
+    EXPECT_EQ(SPSC_SIZE, sh_spsc_fifo_out(fifo, buf_out, 10));
+    EXPECT_EQ(buf_out[0], 6);
+    EXPECT_EQ(buf_out[2], 8);
+    for (int i = 3; i < 8; i++) {
+        EXPECT_EQ(buf_out[i], i - 2);
+    }
+    EXPECT_EQ(0, sh_spsc_fifo_out(fifo, buf_out, 1));
+}
+
+TEST(TEST_SH_SPSC_FIFO_THREAD, spsc_stream_test) {
+    const uint32_t cnt = 200000;
+    sh_spsc_fifo_t *fifo = sh_spsc_fifo_create(64, sizeof(uint32_t));
+    ASSERT_TRUE(fifo);
+
+    std::thread producer([fifo, cnt]() {
+        uint32_t buf[5];
+        uint32_t next = 0;
+
+        while (next < cnt) {
+            uint32_t n = 0;
+            for (; (n < 5) && (next + n < cnt); n++) {
+                buf[n] = next + n;
+            }
+            /* a partial write is retried from the first dropped value */
+            uint32_t len = sh_spsc_fifo_in(fifo, buf, n);
+            if (len == 0) {
+                std::this_thread::yield();
+            }
+            next += len;
+        }
+    });
+
+    uint32_t buf[7];
+    uint32_t expect = 0;
+    bool in_order = true;
+
+    while (expect < cnt) {
+        uint32_t n = sh_spsc_fifo_out(fifo, buf, 7);
+        if (n == 0) {
+            std::this_thread::yield();
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            in_order &= (buf[i] == expect++);
+        }
+    }
+
+    producer.join();
+
+    EXPECT_TRUE(in_order);
+    EXPECT_EQ(0, sh_spsc_fifo_get_used_size(fifo));
+
+    sh_spsc_fifo_destroy(fifo);
+}
@@ -14,9 +14,9 @@ using namespace testing;
 sh_timer_t *timer[TIMER_AMOUNT];
 int timer_cnt[TIMER_AMOUNT] = {0};
 
-uint32_t tick = 0;
+sh_tick_t tick = 0;
 
-static uint32_t windows_get_tick(void)
+static sh_tick_t windows_get_tick(void)
 {
     return tick++;
 }
@@ -107,3 +107,254 @@ TEST_F(TEST_SH_TIMER, timer_malloc_test) {
     EXPECT_EQ(mem_size, sh_get_free_size());
 }
 
+
+TEST_F(TEST_SH_TIMER, next_expiry_test) {
+    sh_tick_t ticks_until = 0;
+
+    EXPECT_EQ(-1, sh_timer_next_expiry(&head, 0, &ticks_until));
+
+    EXPECT_FALSE(sh_timer_start(timer[0], &head, 100, 300));
+    EXPECT_FALSE(sh_timer_start(timer[1], &head, 100, 200));
+
+    EXPECT_EQ(0, sh_timer_next_expiry(&head, 150, &ticks_until));
+    EXPECT_EQ(150, ticks_until);
+
+    EXPECT_EQ(0, sh_timer_next_expiry(&head, 350, &ticks_until));
+    EXPECT_EQ(0, ticks_until);
+
+    sh_timer_stop(timer[1]);
+    EXPECT_EQ(0, sh_timer_next_expiry(&head, 150, &ticks_until));
+    EXPECT_EQ(250, ticks_until);
+}
+
+TEST_F(TEST_SH_TIMER, next_expiry_tick_overflow_test) {
+    sh_tick_t ticks_until = 0;
+
+    EXPECT_FALSE(sh_timer_start(timer[0], &head, UINT32_MAX - 10, 100));
+    EXPECT_FALSE(sh_timer_start(timer[1], &head, UINT32_MAX - 10, 20));
+
+    EXPECT_EQ(0, sh_timer_next_expiry(&head, UINT32_MAX - 10, &ticks_until));
+    EXPECT_EQ(20, ticks_until);
+}
+
+TEST_F(TEST_SH_TIMER, handler_tickless_test) {
+    sh_tick_t ticks_until = 0;
+
+    tick = 0;
+    EXPECT_FALSE(sh_timer_start(timer[0], &head, 0, 100));
+    sh_timer_set_mode(timer[0], SH_TIMER_MODE_SINGLE);
+
+    EXPECT_EQ(0, sh_timer_handler_tickless(&head, &ticks_until));
+    EXPECT_EQ(0, timer_cnt[0]);
+    EXPECT_EQ(99, ticks_until);
+
+    tick = 100;
+    EXPECT_EQ(-1, sh_timer_handler_tickless(&head, &ticks_until));
+    EXPECT_EQ(1, timer_cnt[0]);
+}
+
+TEST_F(TEST_SH_TIMER, batch_expiry_test) {
+    for (int i = 0; i < 5; i++) {
+        sh_timer_set_mode(timer[i], SH_TIMER_MODE_SINGLE);
+        EXPECT_FALSE(sh_timer_start(timer[i], &head, 0, 10));
+    }
+
+    /* timer4 stops timer0~2 while they are waiting in the same batch */
+    sh_list_remove(&timer[4]->list);
+    sh_list_insert_after(&timer[4]->list, &head);
+
+    tick = 10;
+    sh_timer_handler(&head);
+
+    EXPECT_EQ(0, timer_cnt[0]);
+    EXPECT_EQ(0, timer_cnt[1]);
+    EXPECT_EQ(0, timer_cnt[2]);
+    EXPECT_EQ(1, timer_cnt[3]);
+    EXPECT_EQ(1, timer_cnt[4]);
+    EXPECT_TRUE(sh_list_isempty(&head));
+}
+
+TEST_F(TEST_SH_TIMER, batch_rearm_test) {
+    sh_tick_t interval[] = {40, 10, 30, 20};
+
+    /* timer0~4 are due at 40 and re-arm out of deadline order */
+    for (int i = 0; i < 4; i++) {
+        EXPECT_FALSE(sh_timer_start(timer[i], &head, 40 - interval[i], interval[i]));
+    }
+    EXPECT_FALSE(sh_timer_start(timer[4], &head, 0, 40));
+    sh_timer_set_mode(timer[5], SH_TIMER_MODE_SINGLE);
+    EXPECT_FALSE(sh_timer_start(timer[5], &head, 0, 65));
+
+    /* timer4 runs last and stops timer0~2 before they are merged back */
+    tick = 40;
+    sh_timer_handler(&head);
+
+    for (int i = 0; i < 5; i++) {
+        EXPECT_EQ(1, timer_cnt[i]);
+    }
+    EXPECT_FALSE(timer[0]->enable);
+    EXPECT_EQ(3, sh_list_len(&head));
+    EXPECT_EQ(&timer[3]->list, head.next);
+    EXPECT_EQ(&timer[5]->list, head.next->next);
+    EXPECT_EQ(&timer[4]->list, head.prev);
+    EXPECT_EQ(60, timer[3]->overtick);
+    EXPECT_EQ(80, timer[4]->overtick);
+}
+
+TEST_F(TEST_SH_TIMER, periodic_no_drift_test) {
+    sh_timer_set_mode(timer[0], SH_TIMER_MODE_PERIODIC);
+    sh_timer_set_mode(timer[1], SH_TIMER_MODE_LOOP);
+    EXPECT_FALSE(sh_timer_start(timer[0], &head, 0, 10));
+    EXPECT_FALSE(sh_timer_start(timer[1], &head, 0, 10));
+
+    /* the handler always runs 3 ticks late */
+    for (int i = 1; i <= 100; i++) {
+        tick = i * 10 + 3;
+        sh_timer_handler(&head);
+    }
+
+    EXPECT_EQ(100, timer_cnt[0]);
+    EXPECT_EQ(1010, timer[0]->overtick);
+    EXPECT_EQ(1013, timer[1]->overtick);
+}
+
+TEST_F(TEST_SH_TIMER, periodic_catchup_test) {
+    for (int i = 0; i < 3; i++) {
+        sh_timer_set_mode(timer[i], SH_TIMER_MODE_PERIODIC);
+        EXPECT_FALSE(sh_timer_start(timer[i], &head, 0, 10));
+    }
+    sh_timer_set_catchup(timer[0], SH_TIMER_CATCHUP_ALL);
+    sh_timer_set_catchup(timer[1], SH_TIMER_CATCHUP_SKIP);
+    sh_timer_set_catchup(timer[2], SH_TIMER_CATCHUP_ONCE);
+
+    /* 4 deadlines have passed, all of them fire in this one pass */
+    tick = 45;
+    sh_timer_handler(&head);
+
+    EXPECT_EQ(4, timer_cnt[0]);
+    EXPECT_EQ(0, timer_cnt[1]);
+    EXPECT_EQ(1, timer_cnt[2]);
+    EXPECT_EQ(50, timer[0]->overtick);
+    EXPECT_EQ(50, timer[1]->overtick);
+    EXPECT_EQ(50, timer[2]->overtick);
+
+    tick = 45;
+    sh_timer_handler(&head);
+
+    EXPECT_EQ(4, timer_cnt[0]);
+    EXPECT_EQ(0, timer_cnt[1]);
+    EXPECT_EQ(1, timer_cnt[2]);
+}
+
+TEST_F(TEST_SH_TIMER, periodic_catchup_all_test) {
+    sh_timer_set_mode(timer[0], SH_TIMER_MODE_PERIODIC);
+    sh_timer_set_catchup(timer[0], SH_TIMER_CATCHUP_ALL);
+    sh_timer_set_mode(timer[1], SH_TIMER_MODE_SINGLE);
+    EXPECT_FALSE(sh_timer_start(timer[0], &head, 0, 10));
+    EXPECT_FALSE(sh_timer_start(timer[1], &head, 0, 25));
+
+    tick = 10;
+    sh_timer_handler(&head);
+    EXPECT_EQ(1, timer_cnt[0]);
+
+    /* a gap of 3 periods gives 4 callbacks from one handler call */
+    tick = 50;
+    sh_timer_handler(&head);
+    EXPECT_EQ(5, timer_cnt[0]);
+    EXPECT_EQ(1, timer_cnt[1]);
+    EXPECT_EQ(60, timer[0]->overtick);
+    EXPECT_EQ(&timer[0]->list, head.next);
+    EXPECT_EQ(1, sh_list_len(&head));
+}
+
+TEST_F(TEST_SH_TIMER, interval_limit_test) {
+    EXPECT_FALSE(sh_timer_start(timer[0], &head, 0, SH_TICK_MAX / 2));
+    EXPECT_TRUE(sh_timer_start(timer[0], &head, 0, SH_TICK_MAX / 2 + 1));
+
+#if USE_SH_TIMER_TICK64
+    sh_tick_t ticks_until = 0;
+    sh_tick_t hour_us = 3600ull * 1000 * 1000;
+
+    EXPECT_FALSE(sh_timer_start(timer[0], &head, 0, 24 * hour_us));
+    EXPECT_FALSE(sh_timer_start(timer[1], &head, 0, 1));
+    EXPECT_EQ(0, sh_timer_next_expiry(&head, 0, &ticks_until));
+    EXPECT_EQ(1, ticks_until);
+
+    sh_timer_stop(timer[1]);
+    EXPECT_EQ(0, sh_timer_next_expiry(&head, 0, &ticks_until));
+    EXPECT_EQ(24 * hour_us, ticks_until);
+#endif
+}
+
+TEST_F(TEST_SH_TIMER, slack_coalesce_test) {
+    sh_timer_clear_saved_wakeups();
+
+    for (int i = 0; i < 4; i++) {
+        sh_timer_set_mode(timer[i], SH_TIMER_MODE_SINGLE);
+        sh_timer_set_slack(timer[i], 10);
+    }
+
+    /* snapped to the deadline of timer0 */
+    EXPECT_FALSE(sh_timer_start(timer[0], &head, 0, 100));
+    EXPECT_FALSE(sh_timer_start(timer[1], &head, 3, 100));
+    EXPECT_EQ(timer[0]->overtick, timer[1]->overtick);
+    EXPECT_LE(100, timer[0]->overtick);
+    EXPECT_GE(110, timer[0]->overtick);
+
+    /* rounded to the same boundary without any existing deadline */
+    EXPECT_FALSE(sh_timer_start(timer[2], &head, 200, 97));
+    sh_timer_stop(timer[2]);
+    sh_tick_t overtick = timer[2]->overtick;
+    EXPECT_FALSE(sh_timer_start(timer[3], &head, 201, 97));
+    EXPECT_FALSE(sh_timer_start(timer[2], &head, 200, 97));
+    EXPECT_EQ(overtick, timer[2]->overtick);
+    EXPECT_EQ(overtick, timer[3]->overtick);
+    EXPECT_LE(298, overtick);
+    EXPECT_GE(307, overtick);
+
+    for (tick = 0; tick < 400;) {
+        sh_timer_handler(&head);
+    }
+
+    EXPECT_EQ(1, timer_cnt[0]);
+    EXPECT_EQ(1, timer_cnt[1]);
+    EXPECT_EQ(1, timer_cnt[2]);
+    EXPECT_EQ(1, timer_cnt[3]);
+    EXPECT_EQ(2, sh_timer_get_saved_wakeups());
+}
+
+#if USE_SH_TIMER_STATS
+TEST_F(TEST_SH_TIMER, stats_test) {
+    sh_timer_stats_t stats;
+
+    EXPECT_EQ(0, sh_timer_stats_attach(&stats, &head));
+    EXPECT_EQ(-1, sh_timer_stats_attach(&stats, &head));
+
+    sh_timer_set_mode(timer[0], SH_TIMER_MODE_SINGLE);
+    sh_timer_set_mode(timer[1], SH_TIMER_MODE_SINGLE);
+    EXPECT_FALSE(sh_timer_start(timer[0], &head, 0, 10));
+    EXPECT_FALSE(sh_timer_start(timer[1], &head, 0, 15));
+
+    /* fired 10 and 5 ticks late, each callback takes 1 tick */
+    tick = 20;
+    sh_timer_handler(&head);
+
+    EXPECT_EQ(2, stats.cnt);
+    EXPECT_EQ(10, stats.late_max);
+    EXPECT_EQ(7, sh_timer_stats_get_late_mean(&stats));
+    EXPECT_EQ(1, stats.late_hist[3]);
+    EXPECT_EQ(1, stats.late_hist[4]);
+    EXPECT_EQ(1, stats.cb_max);
+    EXPECT_EQ(1, sh_timer_stats_get_cb_mean(&stats));
+    EXPECT_EQ(2, stats.cb_hist[1]);
+
+    sh_timer_stats_reset(&stats);
+    EXPECT_EQ(0, stats.cnt);
+    EXPECT_EQ(0, sh_timer_stats_get_late_mean(&stats));
+
+    sh_timer_stats_detach(&stats);
+    EXPECT_FALSE(sh_timer_start(timer[0], &head, 0, 10));
+    sh_timer_handler(&head);
+    EXPECT_EQ(0, stats.cnt);
+}
+#endif
@@ -0,0 +1,194 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sh_timer_service.h"
+#include "sh_isr.h"
+#include "sh_lib.h"
+
+using namespace testing;
+
+static std::atomic<int> service_cnt(0);
+static int service_event_cnt = 0;
+static pthread_mutex_t service_mutex;
+
+static int service_isr_disable(void)
+{
+    pthread_mutex_lock(&service_mutex);
+    return 0;
+}
+
+static void service_isr_enable(int level)
+{
+    (void)level;
+    pthread_mutex_unlock(&service_mutex);
+}
+
+static sh_tick_t service_get_tick_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (sh_tick_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void service_overtick_cb(void *param)
+{
+    (void)param;
+    service_cnt++;
+}
+
+static void service_event_cb(const sh_event_msg_t *e)
+{
+    (void)e;
+    service_event_cnt++;
+}
+
+class TEST_SH_TIMER_SERVICE : public testing::Test {
+protected:  
+    void SetUp()
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&service_mutex, &attr);
+
+        sh_isr_t isr = {service_isr_disable, service_isr_enable};
+        ASSERT_EQ(0, sh_isr_register(&isr));
+
+        service_cnt = 0;
+        service_event_cnt = 0;
+        sh_list_init(&head);
+        sh_timer_sys_init(service_get_tick_ms);
+
+        service = sh_timer_service_create(16, 1000000);
+        ASSERT_TRUE(service);
+    }
+
+    void TearDown()
+    {
+        sh_timer_service_destroy(service);
+        sh_isr_unregister();
+        pthread_mutex_destroy(&service_mutex);
+    }
+
+    bool wait_for(int cnt)
+    {
+        for (int i = 0; i < 1000; i++) {
+            if (service_cnt >= cnt) {
+                return true;
+            }
+            usleep(1000);
+        }
+        return false;
+    }
+
+    sh_timer_service_t *service;
+    sh_list_t head;
+};
+
+TEST_F(TEST_SH_TIMER_SERVICE, service_start_stop_test) {
+    sh_timer_t timer[3];
+
+    for (int i = 0; i < 3; i++) {
+        sh_timer_init(&timer[i], SH_TIMER_MODE_SINGLE, service_overtick_cb);
+    }
+
+    EXPECT_EQ(0, sh_timer_service_start_timer(service, &timer[0], &head, 5));
+    EXPECT_EQ(0, sh_timer_service_start_timer(service, &timer[1], &head, 10));
+    EXPECT_EQ(0, sh_timer_service_start_timer(service, &timer[2], &head, 300));
+    EXPECT_EQ(0, sh_timer_service_stop_timer(service, &timer[2]));
+
+    EXPECT_TRUE(wait_for(2));
+    usleep(400 * 1000);
+    EXPECT_EQ(2, service_cnt);
+
+    EXPECT_EQ(0, sh_timer_service_restart_timer(service, &timer[0], &head));
+    EXPECT_TRUE(wait_for(3));
+}
+
+TEST_F(TEST_SH_TIMER_SERVICE, service_invalid_interval_test) {
+    sh_timer_t timer;
+
+    sh_timer_init(&timer, SH_TIMER_MODE_SINGLE, service_overtick_cb);
+
+    EXPECT_EQ(-1, sh_timer_service_start_timer(service, &timer, &head, 0));
+    EXPECT_EQ(-1, sh_timer_service_start_timer(service, &timer, &head, SH_TICK_MAX));
+}
+
+TEST_F(TEST_SH_TIMER_SERVICE, service_head_full_test) {
+    /* the service keeps running the lists until it is destroyed */
+    static sh_list_t heads[SH_TIMER_SERVICE_HEAD_MAX];
+    static sh_timer_t timer[SH_TIMER_SERVICE_HEAD_MAX];
+    static sh_timer_t extra;
+    static sh_list_t extra_head;
+
+    for (int i = 0; i < SH_TIMER_SERVICE_HEAD_MAX; i++) {
+        sh_list_init(&heads[i]);
+        sh_timer_init(&timer[i], SH_TIMER_MODE_SINGLE, service_overtick_cb);
+        EXPECT_EQ(0, sh_timer_service_start_timer(service, &timer[i], &heads[i], 5));
+    }
+
+    /* a list the service has no room for is rejected when it is queued */
+    sh_list_init(&extra_head);
+    sh_timer_init(&extra, SH_TIMER_MODE_SINGLE, service_overtick_cb);
+    EXPECT_EQ(-1, sh_timer_service_start_timer(service, &extra, &extra_head, 5));
+    EXPECT_EQ(-1, sh_timer_service_restart_timer(service, &extra, &extra_head));
+    EXPECT_EQ(0, sh_timer_service_start_timer(service, &extra, &heads[0], 5));
+
+    EXPECT_TRUE(wait_for(SH_TIMER_SERVICE_HEAD_MAX + 1));
+    EXPECT_EQ(0, sh_timer_service_get_error_count(service));
+}
+
+TEST_F(TEST_SH_TIMER_SERVICE, service_restart_error_test) {
+    sh_timer_t timer;
+
+    sh_timer_init(&timer, SH_TIMER_MODE_SINGLE, service_overtick_cb);
+
+    /* the timer never ran, so the service thread cannot restart it */
+    EXPECT_EQ(0, sh_timer_service_restart_timer(service, &timer, &head));
+
+    for (int i = 0; (i < 1000) && (sh_timer_service_get_error_count(service) == 0); i++) {
+        usleep(1000);
+    }
+    EXPECT_EQ(1, sh_timer_service_get_error_count(service));
+    EXPECT_EQ(0, service_cnt);
+}
+
+TEST_F(TEST_SH_TIMER_SERVICE, service_post_event_test) {
+    uint8_t event_buf[] = {1, 2};
+    sh_event_map_t *map = sh_event_map_create(SH_GROUP(event_buf));
+    sh_event_server_t *server = sh_event_server_create(map, "service");
+    sh_timer_service_event_t event = {server, 2};
+    sh_timer_t timer;
+
+    ASSERT_TRUE(server);
+    EXPECT_EQ(0, sh_event_subscribe(server, 2, service_event_cb));
+    EXPECT_EQ(0, sh_event_server_start(server));
+
+    sh_timer_init(&timer, SH_TIMER_MODE_SINGLE, sh_timer_service_post_cb);
+    sh_timer_set_param(&timer, &event);
+
+    EXPECT_EQ(0, sh_timer_service_start_timer(service, &timer, &head, 5));
+
+    for (int i = 0; (i < 1000) && (service_event_cnt == 0); i++) {
+        int level = sh_isr_disable();
+        sh_event_handler(server);
+        sh_isr_enable(level);
+        usleep(1000);
+    }
+
+    EXPECT_EQ(1, service_event_cnt);
+
+    sh_event_server_destroy(server);
+    sh_event_map_destroy(map);
+}
+
+#endif
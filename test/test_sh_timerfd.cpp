@@ -0,0 +1,103 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#if defined(__linux__)
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "sh_timerfd.h"
+#include "sh_lib.h"
+
+using namespace testing;
+
+static int timerfd_cnt = 0;
+
+static sh_tick_t linux_get_tick_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (sh_tick_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void timerfd_overtick_cb(void *param)
+{
+    (void)param;
+    timerfd_cnt++;
+}
+
+class TEST_SH_TIMERFD : public testing::Test {
+protected:  
+    void SetUp()
+    {
+        timerfd_cnt = 0;
+        sh_list_init(&head);
+        sh_timer_sys_init(linux_get_tick_ms);
+        sh_timer_init(&timer, SH_TIMER_MODE_SINGLE, timerfd_overtick_cb);
+
+        ASSERT_EQ(0, sh_timerfd_init(&tfd, &head, 1000000));
+
+        epfd = epoll_create1(0);
+        ASSERT_LE(0, epfd);
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ASSERT_EQ(0, epoll_ctl(epfd, EPOLL_CTL_ADD, sh_timerfd_get_fd(&tfd), &ev));
+    }
+
+    void TearDown()
+    {
+        sh_timer_stop(&timer);
+        sh_timerfd_deinit(&tfd);
+        close(epfd);
+    }
+
+    bool is_armed(void)
+    {
+        struct itimerspec spec;
+
+        timerfd_gettime(sh_timerfd_get_fd(&tfd), &spec);
+
+        return (spec.it_value.tv_sec != 0) || (spec.it_value.tv_nsec != 0);
+    }
+
+    sh_list_t head;
+    sh_timer_t timer;
+    sh_timerfd_t tfd;
+    int epfd;
+};
+
+TEST_F(TEST_SH_TIMERFD, timerfd_arm_test) {
+    EXPECT_FALSE(is_armed());
+
+    EXPECT_EQ(0, sh_timer_start(&timer, &head, linux_get_tick_ms(), 1000));
+    EXPECT_TRUE(is_armed());
+
+    sh_timer_stop(&timer);
+    EXPECT_FALSE(is_armed());
+}
+
+TEST_F(TEST_SH_TIMERFD, timerfd_dispatch_test) {
+    struct epoll_event ev;
+    sh_tick_t start = linux_get_tick_ms();
+
+    EXPECT_EQ(0, sh_timer_start(&timer, &head, start, 5));
+
+    while (timerfd_cnt == 0) {
+        ASSERT_EQ(1, epoll_wait(epfd, &ev, 1, 1000));
+        EXPECT_EQ(0, sh_timerfd_dispatch(&tfd));
+    }
+
+    EXPECT_EQ(1, timerfd_cnt);
+    EXPECT_LE(start + 5, linux_get_tick_ms());
+    EXPECT_FALSE(is_armed());
+    EXPECT_EQ(0, epoll_wait(epfd, &ev, 1, 20));
+}
+
+#endif